@@ -45,6 +45,8 @@ Atom				 ewmh[EWMH_NITEMS];
 struct screen_ctx_q		 Screenq = TAILQ_HEAD_INITIALIZER(Screenq);
 
 int				 HasRandr, Randr_ev;
+int				 HasSync, Sync_ev;
+int				 HasXI2, Xi_opcode;
 const char			*homedir;
 
 static void	sighdlr(int);
@@ -148,6 +150,8 @@ main(int argc, char **argv)
 static void
 x_init(const char *dpyname)
 {
+	int	 i, major, minor;
+
 	if ((X_Dpy = XOpenDisplay(dpyname)) == NULL)
 		log_fatal("unable to open display \"%s\"",
 		    XDisplayName(dpyname));
@@ -158,7 +162,19 @@ x_init(const char *dpyname)
 	XSetErrorHandler(x_errorhandler);
 
 	conf_atoms();
+	if (XSyncQueryExtension(X_Dpy, &Sync_ev, &i) &&
+	    XSyncInitialize(X_Dpy, &major, &minor))
+		HasSync = 1;
+	if (XQueryExtension(X_Dpy, "XInputExtension", &Xi_opcode, &i, &i)) {
+		major = 2;
+		minor = 0;
+		if (XIQueryVersion(X_Dpy, &major, &minor) == Success)
+			HasXI2 = 1;
+	}
+	(void)XkbSetDetectableAutoRepeat(X_Dpy, True, NULL);
 	u_init_pipe();
+	exec_cache_init();
+	history_init();
 	screen_maybe_init_randr();
 }
 
@@ -202,6 +218,8 @@ x_teardown(void)
 		}
 		XUnmapWindow(X_Dpy, sc->menuwin);
 		XDestroyWindow(X_Dpy, sc->menuwin);
+		XftDrawDestroy(sc->geomdraw);
+		XDestroyWindow(X_Dpy, sc->geomwin);
 	}
 	XUngrabKey(X_Dpy, AnyKey, AnyModifier,
 		RootWindow(X_Dpy, DefaultScreen(X_Dpy)));
@@ -23,8 +23,10 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/param.h>
+#include <regex.h>
 #include <confuse.h>
 #if defined(__linux__)
 #	include "compat/queue.h"
@@ -49,6 +51,8 @@
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
 #include <X11/extensions/Xrandr.h>
+#include <X11/extensions/sync.h>
+#include <X11/extensions/XInput2.h>
 #include <X11/keysym.h>
 
 #include "array.h"
@@ -101,10 +105,16 @@
 #define CWM_MENU_DUMMY		0x0001
 #define CWM_MENU_FILE		0x0002
 #define CWM_MENU_LIST		0x0004
+#define CWM_MENU_WINDOW		0x0008
 
 #define ARG_CHAR		0x0001
 #define ARG_INT			0x0002
 
+/* action parameters */
+#define CWM_PARAM_NONE		0
+#define CWM_PARAM_GROUP		1	/* required group number */
+#define CWM_PARAM_AMOUNT	2	/* optional amount, in pixels */
+
 #define CWM_TILE_HORIZ 		0x0001
 #define CWM_TILE_VERT 		0x0002
 
@@ -135,6 +145,10 @@ char		*fgetln(FILE *, size_t *);
 union arg {
 	char	*c;
 	int	 i;
+	struct {
+		int	 flags;
+		int	 n;	/* the parameter, or 0 for the default */
+	}	 p;
 };
 
 union press {
@@ -181,9 +195,38 @@ struct gap {
 struct winname {
 	TAILQ_ENTRY(winname)	 entry;
 	char			*name;
+	char			*fold;		/* lowercase, for search */
 };
 TAILQ_HEAD(winname_q, winname);
-TAILQ_HEAD(ignore_q, winname);
+
+enum match_field {
+	MATCH_CLASS,
+	MATCH_INSTANCE,
+	MATCH_TITLE,
+	MATCH_TYPE,
+	MATCH_NFIELDS
+};
+
+struct match_pat {
+#define MATCH_ANY		0
+#define MATCH_EXACT		1
+#define MATCH_GLOB		2
+#define MATCH_REGEX		3
+	int			 kind;
+	char			*str;
+	regex_t			 re;
+};
+
+struct match {
+	TAILQ_ENTRY(match)	 entry;
+	int			 id;
+	char			*desc;
+	int			 nfields; /* how specific this match is */
+	struct match_pat	 pat[MATCH_NFIELDS];
+	int			 group;	/* autogroup, or -1 */
+	int			 ignore;
+};
+TAILQ_HEAD(match_q, match);
 
 struct rule_item {
 	struct binding		*b;
@@ -192,10 +235,18 @@ struct rule_item {
 };
 TAILQ_HEAD(rule_item_q, rule_item);
 
+enum rule_hook_type {
+	RULE_ON_MAP,
+	RULE_ON_FOCUS,
+	RULE_ON_CLOSE,
+	RULE_ON_NET_ACTIVE,
+	RULE_NHOOKS
+};
+
 struct rule {
-	const char		*client_class;
+	struct match		*match;
 	const char		*rule_name;
-	struct client_ctx	*cc;
+	int			 hook;
 	size_t			 ri_size;
 	struct rule_item_q	 rule_item;
 
@@ -203,6 +254,12 @@ struct rule {
 };
 TAILQ_HEAD(rule_q, rule);
 
+/* The rule items which apply to a client for one hook, in order. */
+struct rule_hook {
+	struct rule_item	**items;
+	size_t			  n;
+};
+
 struct geom_record {
 	struct screen_ctx		*sc;
 	struct geom	 		 geom;
@@ -212,6 +269,18 @@ struct geom_record {
 };
 TAILQ_HEAD(geom_recordq, geom_record);
 
+struct grab {
+	unsigned int		 code;	/* keycode or button */
+	unsigned int		 mask;
+};
+
+struct grab_set {
+	struct grab		*list;
+	size_t			 num;
+};
+#define GRAB_KEY		 0x0001
+#define GRAB_BTN		 0x0002
+
 struct config_client;
 struct client_ctx {
 	TAILQ_ENTRY(client_ctx)	 entry;
@@ -272,10 +341,25 @@ struct client_ctx {
 	int			 nameqlen;
 	char			*name;
 	char			*label;
+	char			*label_fold;
+	char			*class_fold;
+	uint32_t		*trigrams;	/* sorted, for trigram.c */
+	size_t			 ntrigrams;
+	XSyncCounter		 sync_counter;	/* _NET_WM_SYNC_REQUEST */
+	XSyncValue		 sync_value;	/* last asked for */
+	XSyncAlarm		 sync_alarm;	/* None unless asked */
+	struct menu		*winmenu;	/* its entry while the window menu is up */
 	char			*matchname;
 	struct group_ctx	*group;
 	XClassHint		ch;
 	XWMHints		*wmh;
+	struct grab_set		 btngrabs;
+	struct rule_hook	 hooks[RULE_NHOOKS];
+	unsigned int		 rule_gen;
+	struct match		**matches;
+	size_t			 nmatches;
+	unsigned int		 match_gen;
+	char			*wintype;	/* "" if it has none */
 };
 TAILQ_HEAD(client_ctx_q, client_ctx);
 
@@ -293,14 +377,6 @@ struct group_ctx {
 };
 TAILQ_HEAD(group_ctx_q, group_ctx);
 
-struct autogroupwin {
-	TAILQ_ENTRY(autogroupwin)	 entry;
-	char				*class;
-	char				*name;
-	int 				 num;
-};
-TAILQ_HEAD(autogroupwin_q, autogroupwin);
-
 #define GLOBAL_SCREEN_NAME "global_monitor"
 struct config_screen;
 struct screen_ctx {
@@ -320,6 +396,8 @@ struct screen_ctx {
 	struct group_ctx_q	 groupq;
 	struct group_ctx	*group_current;
 	XftDraw			*xftdraw;
+	Window			 geomwin;	/* move/resize feedback */
+	XftDraw			*geomdraw;
 };
 TAILQ_HEAD(screen_ctx_q, screen_ctx);
 
@@ -330,6 +408,7 @@ struct binding {
 	unsigned int		 modmask;
 	union press		 press;
 	int			 flags;
+	int			 action; /* index into name_to_func, or -1 */
 };
 TAILQ_HEAD(keybinding_q, binding);
 TAILQ_HEAD(mousebinding_q, binding);
@@ -337,7 +416,7 @@ TAILQ_HEAD(mousebinding_q, binding);
 struct cmd {
 	TAILQ_ENTRY(cmd)	 entry;
 	char			*name;
-	char			 path[PATH_MAX];
+	char			*path;
 };
 TAILQ_HEAD(cmd_q, cmd);
 
@@ -345,24 +424,38 @@ struct menu {
 	TAILQ_ENTRY(menu)	 entry;
 	TAILQ_ENTRY(menu)	 resultentry;
 #define MENU_MAXENTRY		 200
-	char			 text[MENU_MAXENTRY + 1];
-	char			 print[MENU_MAXENTRY + 1];
+	char			*text;
+	char			*print;		/* MENU_MAXENTRY + 1, if used */
+	uint64_t		 printhash;	/* of print, when measured */
+	int			 width;		/* in pixels, 0 if unknown */
+	char			*fold;		/* lowercase text */
 	void			*ctx;
 	short			 dummy;
 	short			 abort;
+	unsigned int		 mark;		/* for menu.c */
+	uint64_t		 charmask;	/* for search.c */
+};
+/*
+ * A TAILQ_HEAD(menu_q, menu), plus the arena its entries are allocated
+ * from; see menuq_init() and menuq_clear().
+ */
+struct menu_q {
+	struct menu		 *tqh_first;
+	struct menu		**tqh_last;
+	struct menu_chunk	 *arena;
 };
-TAILQ_HEAD(menu_q, menu);
+struct menu_src;
 
 #define CONF_FONT	"sans-serif:pixelsize=14:bold"
 #define CONF_MAMOUNT	1
 #define CONF_SNAPDIST	0
 struct keybinding_q	 keybindingq;
 struct mousebinding_q	 mousebindingq;
-struct autogroupwin_q	 autogroupq;
-struct ignore_q		 ignoreq;
+struct match_q		 matchq;
 struct cmd_q		 cmdq;
 struct rule_q		 ruleq;
 struct rule_item_q	 ruleitemq;
+struct grab_set		 keygrabs;	/* on the root window */
 
 struct config_group {
 	int	 bwidth;
@@ -375,13 +468,24 @@ struct config_screen {
 	Cursor		 cursor[CF_NITEMS];
 	struct gap	 gap;
 	int		 snapdist;
+	int		 fuzzy;		/* CWM_FUZZY_* menus */
+	int		 outline;	/* CWM_OUTLINE_* */
 	char		*font;
 	char		*panel_cmd;
 };
 
+#define CWM_FUZZY_WINDOW	0x0001
+#define CWM_FUZZY_APPLICATION	0x0002
+#define CWM_FUZZY_GROUP		0x0004
+#define CWM_FUZZY_EXEC		0x0008
+#define CWM_FUZZY_WM		0x0010
+#define CWM_FUZZY_SSH		0x0020
+
+#define CWM_OUTLINE_MOVE	0x0001
+#define CWM_OUTLINE_RESIZE	0x0002
+
 struct config_client {
-	struct autogroupwin_q	*autogroupq;
-	struct ignore_q		*ignoreq;
+	struct match_q		*matchq;
 };
 
 /* MWM hints */
@@ -416,7 +520,9 @@ extern Display				*X_Dpy;
 extern Time				 Last_Event_Time;
 extern struct screen_ctx_q		 Screenq;
 extern const char			*homedir;
-extern int				 Randr_ev;
+extern int				 HasRandr, Randr_ev;
+extern int				 HasSync, Sync_ev;
+extern int				 HasXI2, Xi_opcode;
 char					*conf_path;
 char					*cwm_pipe;
 char					 known_hosts[PATH_MAX];
@@ -426,6 +532,7 @@ struct name_func {
 	void		 (*handler)(struct client_ctx *, union arg *);
 	int		 flags;
 	union arg	 argument;
+	int		 param;
 };
 
 extern const struct name_func		 name_to_func[];
@@ -457,6 +564,9 @@ enum {
 	_NET_WM_NAME,
 	_NET_WM_DESKTOP,
 	_NET_CLOSE_WINDOW,
+	_NET_WM_WINDOW_TYPE,
+	_NET_WM_SYNC_REQUEST,
+	_NET_WM_SYNC_REQUEST_COUNTER,
 	_NET_WM_STATE,
 #define	_NET_WM_STATES_NITEMS	6
 	_NET_WM_STATE_STICKY,
@@ -505,8 +615,10 @@ void			 client_raise(struct client_ctx *);
 void			 client_resize(struct client_ctx *, int);
 void			 client_scan_for_windows(void);
 void			 client_send_delete(struct client_ctx *);
+void			 client_sync_alarm(XSyncAlarm);
 void			 client_set_wm_state(struct client_ctx *, long);
 void			 client_setactive(struct client_ctx *);
+void			 client_setclass(struct client_ctx *);
 void			 client_setname(struct client_ctx *);
 void			 client_snap(struct client_ctx *, int);
 int			 client_snapcalc(int, int, int, int, int);
@@ -543,12 +655,33 @@ void			 group_toggle_membership_leave(struct client_ctx *);
 void			 group_update_names(struct screen_ctx *);
 struct group_ctx	*group_find_by_num(struct screen_ctx *, int);
 
+void			 exec_cache_init(void);
+void			 exec_cache_get(struct menu_src *);
+
+void			 host_cache_get(struct menu_src *);
+
+void			 history_init(void);
+uint64_t		 history_key(const char *, const char *);
+void			 history_add(uint64_t);
+float			 history_score(uint64_t);
+
+void			 trigram_update(struct client_ctx *);
+void			 trigram_remove(struct client_ctx *);
+int			 trigram_candidates(const char *, size_t,
+			     struct client_ctx ***, size_t *);
+
 void			 search_match_client(struct menu_q *, struct menu_q *,
 			     char *);
 void			 search_match_exec(struct menu_q *, struct menu_q *,
 			     char *);
 void			 search_match_exec_path(struct menu_q *,
 			     struct menu_q *, char *);
+void			 search_match_fuzzy(struct menu_q *, struct menu_q *,
+			     char *);
+void			 search_match_fuzzy_client(struct menu_q *,
+			     struct menu_q *, char *);
+void			 search_match_fuzzy_exec_path(struct menu_q *,
+			     struct menu_q *, char *);
 void			 search_match_path_any(struct menu_q *, struct menu_q *,
 			     char *);
 void			 search_match_text(struct menu_q *, struct menu_q *,
@@ -560,6 +693,7 @@ struct screen_ctx	*screen_find(Window);
 struct geom		 screen_find_xinerama(int, int, int);
 struct screen_ctx	*screen_find_screen(int, int, struct screen_ctx *);
 void			 screen_maybe_init_randr(void);
+unsigned int		 screen_refresh(struct screen_ctx *);
 void			 screen_update_geometry(struct screen_ctx *);
 void			 screen_updatestackingorder(struct screen_ctx *);
 struct screen_ctx	*screen_find_by_name(const char *);
@@ -634,11 +768,27 @@ struct menu  		*menu_filter(struct screen_ctx *, struct menu_q *,
 			     const char *, const char *, int,
 			     void (*)(struct menu_q *, struct menu_q *, char *),
 			     void (*)(struct menu *, int));
+struct menu  		*menu_filter_src(struct screen_ctx *, struct menu_q *,
+			     const char *, const char *, int,
+			     void (*)(struct menu_q *, struct menu_q *, char *),
+			     void (*)(struct menu *, int),
+			     void (*)(struct menu_src *, void *), void *);
+int			 menu_src_add(struct menu_src *, void *,
+			     const char *, ...);
+int			 menu_src_cancelled(struct menu_src *);
+void			 menu_client_add(struct client_ctx *);
+void			 menu_client_remove(struct client_ctx *);
+void			 menu_client_update(struct client_ctx *);
+void			 menuq_init(struct menu_q *);
 void			 menuq_add(struct menu_q *, void *, const char *, ...);
+void			 menuq_add_result(struct menu_q *, struct menu_q *,
+			     void *, const char *, ...);
 void			 menuq_clear(struct menu_q *);
 
+int			 conf_action_find(const char *);
+int			 conf_action_parse(const char *, struct binding *);
 void			 conf_atoms(void);
-void			 conf_autogroup(int, const char *, const char *);
+void			 conf_autogroup(struct match *, int);
 int			 conf_bind_kbd(const char *, const char *);
 int			 conf_bind_mouse(const char *, const char *);
 void			 conf_clear(void);
@@ -646,27 +796,51 @@ void			 conf_client(struct client_ctx *);
 int			 conf_cmd_add(const char *, const char *);
 void			 conf_cursor(struct screen_ctx *);
 void			 conf_grab_kbd(Window);
-void			 conf_grab_mouse(Window);
+void			 conf_grab_mouse(struct client_ctx *);
 void			 conf_init(void);
-void			 conf_ignore(const char *);
+void			 conf_ignore(struct match *);
 void			 conf_screen(struct screen_ctx *, struct group_ctx *);
 
+uint64_t		 config_default_hash(void);
 void			 config_parse(void);
+int			 config_cache_load(void);
+void			 config_cache_save(void);
 
+void			 xev_dispatch(XEvent *);
+const XButtonEvent	*xev_button(void);
+int			 xev_key_repeats(void);
 void			 xev_process(void);
 
+/* match.c */
+struct match		*match_add(const char *, const char *, const char *,
+			     const char *);
+void			 match_clear(void);
+struct match		**match_client(struct client_ctx *, size_t *);
+void			 match_client_clear(struct client_ctx *);
+int			 match_client_has(struct client_ctx *, struct match *);
+void			 match_client_invalidate(struct client_ctx *, int);
+struct match		*match_find_by_index(int);
+
 /* rules.c */
-void			 rule_config(const char *, const char *, const char *);
-void			 rule_apply(struct client_ctx *, const char *);
+void			 rule_add(struct match *, const char *, const char *,
+			     struct binding *);
+void			 rule_clear(void);
+void			 rule_config(struct match *, const char *, const char *);
+void			 rule_apply(struct client_ctx *, int);
+void			 rule_client_clear(struct client_ctx *);
+int			 rule_hook_lookup(const char *);
 const char		*rule_print_rule(struct client_ctx *);
 bool			 rule_validate_title(const char *);
 
-void			 xu_btn_grab(Window, int, unsigned int);
-void			 xu_btn_ungrab(Window);
 int			 xu_getprop(Window, Atom, Atom, long, unsigned char **);
 int			 xu_getstrprop(Window, Atom, char **);
-void			 xu_key_grab(Window, unsigned int, KeySym);
-void			 xu_key_ungrab(Window);
+void			 xu_grab_add(struct grab_set *, unsigned int,
+			     unsigned int);
+void			 xu_grab_clear(struct grab_set *);
+void			 xu_grab_update(Window, struct grab_set *,
+			     struct grab_set *, int);
+KeyCode			 xu_key_resolve(KeySym, unsigned int *);
+void			 xu_key_ungrab_all(Window, struct grab_set *);
 void			 xu_ptr_getpos(Window, int *, int *);
 int			 xu_ptr_grab(Window, unsigned int, Cursor);
 int			 xu_ptr_regrab(unsigned int, Cursor);
@@ -699,6 +873,9 @@ void 			 xu_ewmh_set_net_wm_state(struct client_ctx *);
 void 			 xu_ewmh_restore_net_wm_state(struct client_ctx *);
 
 void			 u_exec(char *);
+uint64_t		 u_hash(const void *, size_t, uint64_t);
+char			*u_fold(const char *);
+char			*u_cache_path(const char *);
 void			 u_spawn(char *);
 void			 u_init_pipe(void);
 void			 u_put_status(void);
@@ -24,13 +24,17 @@
 #include <err.h>
 #include <errno.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "calmwm.h"
 
+#define CLIENT_SYNC_TIMEOUT	100	/* ms */
+
 #define OVERLAP(a,b,c,d) (((a)==(c) && (b)==(d)) || \
 		MIN((a)+(b), (c)+(d)) - MAX((a), (c)) > 0)
 
@@ -46,6 +50,11 @@ static void			 client_expand_horiz(struct client_ctx *,
 static void			 client_expand_vert(struct client_ctx *,
 					struct geom *);
 static void			 client_remove_geom(struct client_ctx *);
+static void			 client_sync_init(struct client_ctx *);
+static Bool			 client_sync_pred(Display *, XEvent *,
+					XPointer);
+static void			 client_sync_wait(struct client_ctx *);
+static void			 client_sync_request(struct client_ctx *);
 
 struct client_ctx	*curcc = NULL;
 
@@ -129,7 +138,7 @@ client_scan_for_windows(void)
 				if (client_inbound(cc, ptr_x, ptr_y))
 					client_setactive(cc);
 
-				rule_apply(cc, "on-map");
+				rule_apply(cc, RULE_ON_MAP);
 			}
 		}
 		client_data_extend(cc);
@@ -206,7 +215,7 @@ client_init(Window win, int skip_map_check)
 	TAILQ_INIT(&cc->nameq);
 	client_setname(cc);
 
-	XGetClassHint(X_Dpy, cc->win, &cc->ch);
+	client_setclass(cc);
 
 	client_wm_hints(cc);
 	client_wm_protocols(cc);
@@ -240,12 +249,14 @@ client_init(Window win, int skip_map_check)
 
 	XSelectInput(X_Dpy, cc->win, ColormapChangeMask | EnterWindowMask |
 	    PropertyChangeMask | KeyReleaseMask);
+	conf_grab_mouse(cc);
 
 	XAddToSaveSet(X_Dpy, cc->win);
 
 	client_transient(cc);
 
 	TAILQ_INSERT_TAIL(&sc->clientq, cc, entry);
+	menu_client_add(cc);
 
 	xu_ewmh_net_client_list(sc);
 	xu_ewmh_net_client_list_stacking(sc);
@@ -287,6 +298,7 @@ client_delete(struct client_ctx *cc)
 	struct winname		*wn;
 
 	TAILQ_REMOVE(&sc->clientq, cc, entry);
+	menu_client_remove(cc);
 
 	xu_ewmh_net_client_list(sc);
 	xu_ewmh_net_client_list_stacking(sc);
@@ -300,8 +312,13 @@ client_delete(struct client_ctx *cc)
 	while ((wn = TAILQ_FIRST(&cc->nameq)) != NULL) {
 		TAILQ_REMOVE(&cc->nameq, wn, entry);
 		free(wn->name);
+		free(wn->fold);
 		free(wn);
 	}
+	trigram_remove(cc);
+	free(cc->label);
+	free(cc->label_fold);
+	free(cc->class_fold);
 
 	client_remove_geom(cc);
 
@@ -312,6 +329,14 @@ client_delete(struct client_ctx *cc)
 	if (cc->wmh)
 		XFree(cc->wmh);
 
+	if (cc->sync_alarm != None)
+		XSyncDestroyAlarm(X_Dpy, cc->sync_alarm);
+
+	/* The window is gone, and its grabs with it. */
+	xu_grab_clear(&cc->btngrabs);
+	rule_client_clear(cc);
+	match_client_clear(cc);
+
 	u_put_status();
 
 	free(cc);
@@ -349,7 +374,6 @@ client_setactive(struct client_ctx *cc)
 	cc->flags |= CLIENT_ACTIVE;
 	cc->flags &= ~CLIENT_URGENCY;
 	client_draw_border(cc);
-	conf_grab_mouse(cc->win);
 
 	xu_ewmh_net_active_window(sc, cc->win);
 
@@ -845,6 +869,10 @@ client_resize(struct client_ctx *cc, int reset)
 
 	client_applysizehints(cc);
 
+	/* Don't get ahead of the client's redrawing, if it says. */
+	client_sync_wait(cc);
+	client_sync_request(cc);
+
 	XMoveResizeWindow(X_Dpy, cc->win, cc->geom.x,
 	    cc->geom.y, cc->geom.w, cc->geom.h);
 
@@ -1073,11 +1101,134 @@ client_wm_protocols(struct client_ctx *cc)
 				cc->flags |= CLIENT_WM_DELETE_WINDOW;
 			else if (p[i] == cwmh[WM_TAKE_FOCUS])
 				cc->flags |= CLIENT_WM_TAKE_FOCUS;
+			else if (p[i] == ewmh[_NET_WM_SYNC_REQUEST])
+				client_sync_init(cc);
 		}
 		XFree(p);
 	}
 }
 
+/*
+ * _NET_WM_SYNC_REQUEST: before each resize the client is sent a value,
+ * which it sets its counter to once it has redrawn at the new size.  An
+ * alarm on the counter says when that is, and the next resize waits for
+ * it, for a while.
+ */
+static void
+client_sync_init(struct client_ctx *cc)
+{
+	long	*p;
+
+	if (!HasSync)
+		return;
+	if (xu_getprop(cc->win, ewmh[_NET_WM_SYNC_REQUEST_COUNTER],
+	    XA_CARDINAL, 1L, (unsigned char **)&p) <= 0)
+		return;
+	cc->sync_counter = *p;
+	XFree(p);
+
+	if (!XSyncQueryCounter(X_Dpy, cc->sync_counter, &cc->sync_value)) {
+		cc->sync_counter = None;
+		return;
+	}
+	log_debug("%s: window 0x%lx: counter 0x%lx", __func__, cc->win,
+	    cc->sync_counter);
+}
+
+static Bool
+client_sync_pred(Display *dpy, XEvent *e, XPointer arg)
+{
+	struct client_ctx	*cc = (struct client_ctx *)arg;
+
+	return((e->type - Sync_ev) == XSyncAlarmNotify &&
+	    ((XSyncAlarmNotifyEvent *)e)->alarm == cc->sync_alarm);
+}
+
+static void
+client_sync_wait(struct client_ctx *cc)
+{
+	struct pollfd	 pfd;
+	struct timespec	 t0, t1;
+	XEvent		 e;
+	int		 ms;
+
+	if (cc->sync_alarm == None)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (;;) {
+		if (XCheckIfEvent(X_Dpy, &e, client_sync_pred, (XPointer)cc))
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ms = CLIENT_SYNC_TIMEOUT - ((t1.tv_sec - t0.tv_sec) * 1000 +
+		    (t1.tv_nsec - t0.tv_nsec) / 1000000);
+		if (ms <= 0) {
+			log_debug("%s: window 0x%lx: timed out", __func__,
+			    cc->win);
+			break;
+		}
+		pfd.fd = ConnectionNumber(X_Dpy);
+		pfd.events = POLLIN;
+		(void)poll(&pfd, 1, ms);
+	}
+	XSyncDestroyAlarm(X_Dpy, cc->sync_alarm);
+	cc->sync_alarm = None;
+}
+
+static void
+client_sync_request(struct client_ctx *cc)
+{
+	XClientMessageEvent	 cm;
+	XSyncAlarmAttributes	 attr;
+	XSyncValue		 one;
+	Bool			 overflow;
+
+	/* Hidden windows won't redraw, so would never answer. */
+	if (cc->sync_counter == None || (cc->flags & CLIENT_HIDDEN))
+		return;
+
+	XSyncIntToValue(&one, 1);
+	XSyncValueAdd(&cc->sync_value, cc->sync_value, one, &overflow);
+
+	(void)memset(&cm, 0, sizeof(cm));
+	cm.type = ClientMessage;
+	cm.window = cc->win;
+	cm.message_type = cwmh[WM_PROTOCOLS];
+	cm.format = 32;
+	cm.data.l[0] = ewmh[_NET_WM_SYNC_REQUEST];
+	cm.data.l[1] = Last_Event_Time;
+	cm.data.l[2] = XSyncValueLow32(cc->sync_value);
+	cm.data.l[3] = XSyncValueHigh32(cc->sync_value);
+	XSendEvent(X_Dpy, cc->win, False, NoEventMask, (XEvent *)&cm);
+
+	attr.trigger.counter = cc->sync_counter;
+	attr.trigger.value_type = XSyncAbsolute;
+	attr.trigger.wait_value = cc->sync_value;
+	attr.trigger.test_type = XSyncPositiveComparison;
+	attr.events = True;
+	cc->sync_alarm = XSyncCreateAlarm(X_Dpy, XSyncCACounter |
+	    XSyncCAValueType | XSyncCAValue | XSyncCATestType | XSyncCAEvents,
+	    &attr);
+}
+
+/* The client caught up with a resize while nobody was waiting. */
+void
+client_sync_alarm(XSyncAlarm alarm)
+{
+	struct screen_ctx	*sc;
+	struct client_ctx	*cc;
+
+	TAILQ_FOREACH(sc, &Screenq, entry) {
+		TAILQ_FOREACH(cc, &sc->clientq, entry) {
+			if (cc->sync_alarm == alarm) {
+				XSyncDestroyAlarm(X_Dpy, cc->sync_alarm);
+				cc->sync_alarm = None;
+				return;
+			}
+		}
+	}
+}
+
 void
 client_wm_hints(struct client_ctx *cc)
 {
@@ -1116,6 +1267,26 @@ client_send_delete(struct client_ctx *cc)
 		XKillClient(X_Dpy, cc->win);
 }
 
+void
+client_setclass(struct client_ctx *cc)
+{
+	if (cc->ch.res_class)
+		XFree(cc->ch.res_class);
+	if (cc->ch.res_name)
+		XFree(cc->ch.res_name);
+	cc->ch.res_class = cc->ch.res_name = NULL;
+
+	XGetClassHint(X_Dpy, cc->win, &cc->ch);
+
+	free(cc->class_fold);
+	cc->class_fold = NULL;
+	if (cc->ch.res_class != NULL)
+		cc->class_fold = u_fold(cc->ch.res_class);
+	trigram_update(cc);
+
+	match_client_invalidate(cc, MATCH_CLASS);
+}
+
 void
 client_setname(struct client_ctx *cc)
 {
@@ -1131,16 +1302,19 @@ client_setname(struct client_ctx *cc)
 			/* Move to the last since we got a hit. */
 			TAILQ_REMOVE(&cc->nameq, wn, entry);
 			TAILQ_INSERT_TAIL(&cc->nameq, wn, entry);
+			free(newname);
 			goto match;
 		}
 	}
 	wn = xmalloc(sizeof(*wn));
 	wn->name = newname;
+	wn->fold = u_fold(newname);
 	TAILQ_INSERT_TAIL(&cc->nameq, wn, entry);
 	cc->nameqlen++;
 
 match:
 	cc->name = wn->name;
+	match_client_invalidate(cc, MATCH_TITLE);
 
 	/* Now, do some garbage collection. */
 	if (cc->nameqlen > CLIENT_MAXNAMEQLEN) {
@@ -1148,9 +1322,12 @@ match:
 		assert(wn != NULL);
 		TAILQ_REMOVE(&cc->nameq, wn, entry);
 		free(wn->name);
+		free(wn->fold);
 		free(wn);
 		cc->nameqlen--;
 	}
+	trigram_update(cc);
+	menu_client_update(cc);
 	u_put_status();
 }
 
@@ -21,6 +21,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <ctype.h>
 #include <err.h>
 #include <errno.h>
 #include <limits.h>
@@ -31,139 +32,135 @@
 
 #include "calmwm.h"
 
+static int		 conf_action_cmp(const void *, const void *);
 static const char	*conf_bind_getmask(const char *, unsigned int *);
 static void	 	 conf_cmd_remove(const char *);
 static void	 	 conf_unbind_kbd(struct binding *);
 static void	 	 conf_unbind_mouse(struct binding *);
 
+/*
+ * Keep this sorted by tag: it's searched with bsearch().  Actions taking a
+ * parameter ("group 3", "moveup 20") say what kind in the last column.
+ */
 const struct name_func name_to_func[] = {
-	{ "lower", kbfunc_client_lower, CWM_WIN, {0} },
-	{ "raise", kbfunc_client_raise, CWM_WIN, {0} },
-	{ "search", kbfunc_client_search, 0, {0} },
-	{ "menusearch", kbfunc_menu_cmd, 0, {0} },
-	{ "groupsearch", kbfunc_menu_group, 0, {0} },
-	{ "hide", kbfunc_client_hide, CWM_WIN, {0} },
-	{ "expand", kbfunc_client_expand, CWM_WIN, {0} },
-	{ "cycle", kbfunc_client_cycle, CWM_WIN, {.i = CWM_CYCLE} },
-	{ "rcycle", kbfunc_client_cycle, CWM_WIN, {.i = CWM_RCYCLE} },
-	{ "label", kbfunc_client_label, CWM_WIN, {0} },
-	{ "delete", kbfunc_client_delete, CWM_WIN, {0} },
-	{ "group0", kbfunc_client_group, CWM_WIN, {.i = 0} },
-	{ "group1", kbfunc_client_group, CWM_WIN, {.i = 1} },
-	{ "group2", kbfunc_client_group, CWM_WIN, {.i = 2} },
-	{ "group3", kbfunc_client_group, CWM_WIN, {.i = 3} },
-	{ "group4", kbfunc_client_group, CWM_WIN, {.i = 4} },
-	{ "group5", kbfunc_client_group, CWM_WIN, {.i = 5} },
-	{ "group6", kbfunc_client_group, CWM_WIN, {.i = 6} },
-	{ "group7", kbfunc_client_group, CWM_WIN, {.i = 7} },
-	{ "group8", kbfunc_client_group, CWM_WIN, {.i = 8} },
-	{ "group9", kbfunc_client_group, CWM_WIN, {.i = 9} },
-	{ "grouponly0", kbfunc_client_grouponly, CWM_WIN, {.i = 0} },
-	{ "grouponly1", kbfunc_client_grouponly, CWM_WIN, {.i = 1} },
-	{ "grouponly2", kbfunc_client_grouponly, CWM_WIN, {.i = 2} },
-	{ "grouponly3", kbfunc_client_grouponly, CWM_WIN, {.i = 3} },
-	{ "grouponly4", kbfunc_client_grouponly, CWM_WIN, {.i = 4} },
-	{ "grouponly5", kbfunc_client_grouponly, CWM_WIN, {.i = 5} },
-	{ "grouponly6", kbfunc_client_grouponly, CWM_WIN, {.i = 6} },
-	{ "grouponly7", kbfunc_client_grouponly, CWM_WIN, {.i = 7} },
-	{ "grouponly8", kbfunc_client_grouponly, CWM_WIN, {.i = 8} },
-	{ "grouponly9", kbfunc_client_grouponly, CWM_WIN, {.i = 9} },
-	{ "movetogroup0", kbfunc_client_movetogroup, CWM_WIN, {.i = 0} },
-	{ "movetogroup1", kbfunc_client_movetogroup, CWM_WIN, {.i = 1} },
-	{ "movetogroup2", kbfunc_client_movetogroup, CWM_WIN, {.i = 2} },
-	{ "movetogroup3", kbfunc_client_movetogroup, CWM_WIN, {.i = 3} },
-	{ "movetogroup4", kbfunc_client_movetogroup, CWM_WIN, {.i = 4} },
-	{ "movetogroup5", kbfunc_client_movetogroup, CWM_WIN, {.i = 5} },
-	{ "movetogroup6", kbfunc_client_movetogroup, CWM_WIN, {.i = 6} },
-	{ "movetogroup7", kbfunc_client_movetogroup, CWM_WIN, {.i = 7} },
-	{ "movetogroup8", kbfunc_client_movetogroup, CWM_WIN, {.i = 8} },
-	{ "movetogroup9", kbfunc_client_movetogroup, CWM_WIN, {.i = 9} },
-	{ "nogroup", kbfunc_client_nogroup, CWM_WIN, {0} },
-	{ "cyclegroup", kbfunc_client_cyclegroup, CWM_WIN, {.i = CWM_CYCLE} },
-	{ "rcyclegroup", kbfunc_client_cyclegroup, CWM_WIN, {.i = CWM_RCYCLE} },
-	{ "cycleingroup", kbfunc_client_cycle, CWM_WIN,
-	    {.i = CWM_CYCLE|CWM_INGROUP} },
-	{ "rcycleingroup", kbfunc_client_cycle, CWM_WIN,
-	    {.i = CWM_RCYCLE|CWM_INGROUP} },
-	{ "grouptoggle", kbfunc_client_grouptoggle, CWM_WIN, {.i = 0}},
-	{ "sticky", kbfunc_client_toggle_sticky, CWM_WIN, {0} },
-	{ "fullscreen", kbfunc_client_toggle_fullscreen, CWM_WIN, {0} },
-	{ "maximize", kbfunc_client_toggle_maximize, CWM_WIN, {0} },
-	{ "vmaximize", kbfunc_client_toggle_vmaximize, CWM_WIN, {0} },
-	{ "hmaximize", kbfunc_client_toggle_hmaximize, CWM_WIN, {0} },
-	{ "freeze", kbfunc_client_toggle_freeze, CWM_WIN, {0} },
-	{ "restart", kbfunc_cwm_status, 0, {.i = CWM_RESTART} },
-	{ "quit", kbfunc_cwm_status, 0, {.i = CWM_QUIT} },
-	{ "exec", kbfunc_exec, 0, {.i = CWM_EXEC_PROGRAM} },
-	{ "exec_wm", kbfunc_exec, 0, {.i = CWM_EXEC_WM} },
-	{ "ssh", kbfunc_ssh, 0, {0} },
-	{ "terminal", kbfunc_term, 0, {0} },
-	{ "lock", kbfunc_lock, 0, {0} },
-	{ "moveup", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_UP|CWM_MOVE)} },
-	{ "movedown", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_DOWN|CWM_MOVE)} },
-	{ "moveright", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_RIGHT|CWM_MOVE)} },
-	{ "moveleft", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_LEFT|CWM_MOVE)} },
-	{ "bigmoveup", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_UP|CWM_MOVE|CWM_BIGMOVE)} },
 	{ "bigmovedown", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_DOWN|CWM_MOVE|CWM_BIGMOVE)} },
-	{ "bigmoveright", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_RIGHT|CWM_MOVE|CWM_BIGMOVE)} },
+	    {.p = {CWM_DOWN|CWM_MOVE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
 	{ "bigmoveleft", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_LEFT|CWM_MOVE|CWM_BIGMOVE)} },
-	{ "resizeup", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_UP|CWM_RESIZE)} },
-	{ "resizedown", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_DOWN|CWM_RESIZE)} },
-	{ "resizeright", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_RIGHT|CWM_RESIZE)} },
-	{ "resizeleft", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_LEFT|CWM_RESIZE)} },
-	{ "bigresizeup", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_UP|CWM_RESIZE|CWM_BIGMOVE)} },
+	    {.p = {CWM_LEFT|CWM_MOVE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "bigmoveright", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_RIGHT|CWM_MOVE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "bigmoveup", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_UP|CWM_MOVE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "bigptrmovedown", kbfunc_client_moveresize, 0,
+	    {.p = {CWM_DOWN|CWM_PTRMOVE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "bigptrmoveleft", kbfunc_client_moveresize, 0,
+	    {.p = {CWM_LEFT|CWM_PTRMOVE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "bigptrmoveright", kbfunc_client_moveresize, 0,
+	    {.p = {CWM_RIGHT|CWM_PTRMOVE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "bigptrmoveup", kbfunc_client_moveresize, 0,
+	    {.p = {CWM_UP|CWM_PTRMOVE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
 	{ "bigresizedown", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_DOWN|CWM_RESIZE|CWM_BIGMOVE)} },
-	{ "bigresizeright", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_RIGHT|CWM_RESIZE|CWM_BIGMOVE)} },
+	    {.p = {CWM_DOWN|CWM_RESIZE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
 	{ "bigresizeleft", kbfunc_client_moveresize, CWM_WIN,
-	    {.i = (CWM_LEFT|CWM_RESIZE|CWM_BIGMOVE)} },
-	{ "ptrmoveup", kbfunc_client_moveresize, 0,
-	    {.i = (CWM_UP|CWM_PTRMOVE)} },
+	    {.p = {CWM_LEFT|CWM_RESIZE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "bigresizeright", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_RIGHT|CWM_RESIZE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "bigresizeup", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_UP|CWM_RESIZE|CWM_BIGMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "cycle", kbfunc_client_cycle, CWM_WIN,
+	    {.i = CWM_CYCLE}, CWM_PARAM_NONE },
+	{ "cyclegroup", kbfunc_client_cyclegroup, CWM_WIN,
+	    {.i = CWM_CYCLE}, CWM_PARAM_NONE },
+	{ "cycleingroup", kbfunc_client_cycle, CWM_WIN,
+	    {.i = CWM_CYCLE|CWM_INGROUP}, CWM_PARAM_NONE },
+	{ "delete", kbfunc_client_delete, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "exec", kbfunc_exec, 0, {.i = CWM_EXEC_PROGRAM}, CWM_PARAM_NONE },
+	{ "exec_wm", kbfunc_exec, 0, {.i = CWM_EXEC_WM}, CWM_PARAM_NONE },
+	{ "expand", kbfunc_client_expand, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "freeze", kbfunc_client_toggle_freeze, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "fullscreen", kbfunc_client_toggle_fullscreen, CWM_WIN,
+	    {0}, CWM_PARAM_NONE },
+	{ "group", kbfunc_client_group, CWM_WIN, {0}, CWM_PARAM_GROUP },
+	{ "grouponly", kbfunc_client_grouponly, CWM_WIN, {0}, CWM_PARAM_GROUP },
+	{ "groupsearch", kbfunc_menu_group, 0, {0}, CWM_PARAM_NONE },
+	{ "grouptoggle", kbfunc_client_grouptoggle, CWM_WIN,
+	    {.i = 0}, CWM_PARAM_NONE },
+	{ "hide", kbfunc_client_hide, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "hmaximize", kbfunc_client_toggle_hmaximize, CWM_WIN,
+	    {0}, CWM_PARAM_NONE },
+	{ "htile", kbfunc_tile, CWM_WIN,
+	    {.i = CWM_TILE_HORIZ}, CWM_PARAM_NONE },
+	{ "label", kbfunc_client_label, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "lock", kbfunc_lock, 0, {0}, CWM_PARAM_NONE },
+	{ "lower", kbfunc_client_lower, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "maximize", kbfunc_client_toggle_maximize, CWM_WIN,
+	    {0}, CWM_PARAM_NONE },
+	{ "menu_cmd", mousefunc_menu_cmd, 0, {0}, CWM_PARAM_NONE },
+	{ "menu_group", mousefunc_menu_group, 0, {0}, CWM_PARAM_NONE },
+	{ "menu_unhide", mousefunc_menu_unhide, 0, {0}, CWM_PARAM_NONE },
+	{ "menusearch", kbfunc_menu_cmd, 0, {0}, CWM_PARAM_NONE },
+	{ "movedown", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_DOWN|CWM_MOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "moveleft", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_LEFT|CWM_MOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "moveright", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_RIGHT|CWM_MOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "movetogroup", kbfunc_client_movetogroup, CWM_WIN,
+	    {0}, CWM_PARAM_GROUP },
+	{ "moveup", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_UP|CWM_MOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "nogroup", kbfunc_client_nogroup, CWM_WIN, {0}, CWM_PARAM_NONE },
 	{ "ptrmovedown", kbfunc_client_moveresize, 0,
-	    {.i = (CWM_DOWN|CWM_PTRMOVE)} },
+	    {.p = {CWM_DOWN|CWM_PTRMOVE, 0}}, CWM_PARAM_AMOUNT },
 	{ "ptrmoveleft", kbfunc_client_moveresize, 0,
-	    {.i = (CWM_LEFT|CWM_PTRMOVE)} },
+	    {.p = {CWM_LEFT|CWM_PTRMOVE, 0}}, CWM_PARAM_AMOUNT },
 	{ "ptrmoveright", kbfunc_client_moveresize, 0,
-	    {.i = (CWM_RIGHT|CWM_PTRMOVE)} },
-	{ "bigptrmoveup", kbfunc_client_moveresize, 0,
-	    {.i = (CWM_UP|CWM_PTRMOVE|CWM_BIGMOVE)} },
-	{ "bigptrmovedown", kbfunc_client_moveresize, 0,
-	    {.i = (CWM_DOWN|CWM_PTRMOVE|CWM_BIGMOVE)} },
-	{ "bigptrmoveleft", kbfunc_client_moveresize, 0,
-	    {.i = (CWM_LEFT|CWM_PTRMOVE|CWM_BIGMOVE)} },
-	{ "bigptrmoveright", kbfunc_client_moveresize, 0,
-	    {.i = (CWM_RIGHT|CWM_PTRMOVE|CWM_BIGMOVE)} },
-	{ "snapup", kbfunc_client_snap, CWM_WIN, {.i = (CWM_SNAP_UP) } },
-	{ "snapdown", kbfunc_client_snap, CWM_WIN, {.i = (CWM_SNAP_DOWN) } },
-	{ "snapleft", kbfunc_client_snap, CWM_WIN, {.i = (CWM_SNAP_LEFT) } },
-	{ "snapright", kbfunc_client_snap, CWM_WIN, {.i = (CWM_SNAP_RIGHT) } },
-	{ "htile", kbfunc_tile, CWM_WIN, {.i = CWM_TILE_HORIZ} },
-	{ "vtile", kbfunc_tile, CWM_WIN, {.i = CWM_TILE_VERT} },
-	{ "window_lower", kbfunc_client_lower, CWM_WIN, {0} },
-	{ "window_raise", kbfunc_client_raise, CWM_WIN, {0} },
-	{ "window_hide", kbfunc_client_hide, CWM_WIN, {0} },
-	{ "window_move", mousefunc_client_move, CWM_WIN, {0} },
-	{ "window_resize", mousefunc_client_resize, CWM_WIN, {0} },
-	{ "window_grouptoggle", kbfunc_client_grouptoggle, CWM_WIN, {.i = 1} },
-	{ "menu_group", mousefunc_menu_group, 0, {0} },
-	{ "menu_unhide", mousefunc_menu_unhide, 0, {0} },
-	{ "menu_cmd", mousefunc_menu_cmd, 0, {0} },
-	{ "toggle_border", kbfunc_client_toggle_border, CWM_WIN, {0} },
-	{ NULL, NULL, 0, {0} },
+	    {.p = {CWM_RIGHT|CWM_PTRMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "ptrmoveup", kbfunc_client_moveresize, 0,
+	    {.p = {CWM_UP|CWM_PTRMOVE, 0}}, CWM_PARAM_AMOUNT },
+	{ "quit", kbfunc_cwm_status, 0, {.i = CWM_QUIT}, CWM_PARAM_NONE },
+	{ "raise", kbfunc_client_raise, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "rcycle", kbfunc_client_cycle, CWM_WIN,
+	    {.i = CWM_RCYCLE}, CWM_PARAM_NONE },
+	{ "rcyclegroup", kbfunc_client_cyclegroup, CWM_WIN,
+	    {.i = CWM_RCYCLE}, CWM_PARAM_NONE },
+	{ "rcycleingroup", kbfunc_client_cycle, CWM_WIN,
+	    {.i = CWM_RCYCLE|CWM_INGROUP}, CWM_PARAM_NONE },
+	{ "resizedown", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_DOWN|CWM_RESIZE, 0}}, CWM_PARAM_AMOUNT },
+	{ "resizeleft", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_LEFT|CWM_RESIZE, 0}}, CWM_PARAM_AMOUNT },
+	{ "resizeright", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_RIGHT|CWM_RESIZE, 0}}, CWM_PARAM_AMOUNT },
+	{ "resizeup", kbfunc_client_moveresize, CWM_WIN,
+	    {.p = {CWM_UP|CWM_RESIZE, 0}}, CWM_PARAM_AMOUNT },
+	{ "restart", kbfunc_cwm_status, 0, {.i = CWM_RESTART}, CWM_PARAM_NONE },
+	{ "search", kbfunc_client_search, 0, {0}, CWM_PARAM_NONE },
+	{ "snapdown", kbfunc_client_snap, CWM_WIN,
+	    {.i = (CWM_SNAP_DOWN) }, CWM_PARAM_NONE },
+	{ "snapleft", kbfunc_client_snap, CWM_WIN,
+	    {.i = (CWM_SNAP_LEFT) }, CWM_PARAM_NONE },
+	{ "snapright", kbfunc_client_snap, CWM_WIN,
+	    {.i = (CWM_SNAP_RIGHT) }, CWM_PARAM_NONE },
+	{ "snapup", kbfunc_client_snap, CWM_WIN,
+	    {.i = (CWM_SNAP_UP) }, CWM_PARAM_NONE },
+	{ "ssh", kbfunc_ssh, 0, {0}, CWM_PARAM_NONE },
+	{ "sticky", kbfunc_client_toggle_sticky, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "terminal", kbfunc_term, 0, {0}, CWM_PARAM_NONE },
+	{ "toggle_border", kbfunc_client_toggle_border, CWM_WIN,
+	    {0}, CWM_PARAM_NONE },
+	{ "vmaximize", kbfunc_client_toggle_vmaximize, CWM_WIN,
+	    {0}, CWM_PARAM_NONE },
+	{ "vtile", kbfunc_tile, CWM_WIN, {.i = CWM_TILE_VERT}, CWM_PARAM_NONE },
+	{ "window_grouptoggle", kbfunc_client_grouptoggle, CWM_WIN,
+	    {.i = 1}, CWM_PARAM_NONE },
+	{ "window_hide", kbfunc_client_hide, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "window_lower", kbfunc_client_lower, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "window_move", mousefunc_client_move, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "window_raise", kbfunc_client_raise, CWM_WIN, {0}, CWM_PARAM_NONE },
+	{ "window_resize", mousefunc_client_resize, CWM_WIN,
+	    {0}, CWM_PARAM_NONE },
+	{ NULL, NULL, 0, {0}, CWM_PARAM_NONE },
 };
 
 static const struct {
@@ -176,19 +173,136 @@ static const struct {
 	{ 'S',	ShiftMask },
 };
 
+static int
+conf_action_cmp(const void *key, const void *elem)
+{
+	return(strcmp(key, ((const struct name_func *)elem)->tag));
+}
+
+/* Return the index of the named action in name_to_func[], or -1. */
+int
+conf_action_find(const char *name)
+{
+	const struct name_func	*nf;
+
+	nf = bsearch(name, name_to_func, nitems(name_to_func) - 1,
+	    sizeof(*name_to_func), conf_action_cmp);
+
+	return(nf == NULL ? -1 : nf - name_to_func);
+}
+
+/*
+ * Parse an action, with its parameter if it takes one, into b.  Accepted
+ * forms are "group 3", the older "group3", "moveup 20" and "move up 20".
+ * Returns 1 on success, 0 if cmd isn't an action at all (so it may be a
+ * command line), or -1 if it names an action that takes a parameter but
+ * the parameter is bad.
+ */
+int
+conf_action_parse(const char *cmd, struct binding *b)
+{
+	const struct name_func	*nf;
+	char			 buf[128], name[128], *words[4], *last;
+	const char		*param = NULL, *errstr;
+	size_t			 len;
+	int			 idx, n = 0, used = 1, num;
+
+	if (strlcpy(buf, cmd, sizeof(buf)) >= sizeof(buf))
+		return(0);
+	for (words[n] = strtok_r(buf, " \t", &last); words[n] != NULL;
+	    words[n] = strtok_r(NULL, " \t", &last)) {
+		/* Enough to know whether there are too many. */
+		if (++n == nitems(words))
+			break;
+	}
+	if (n == 0)
+		return(0);
+
+	if ((idx = conf_action_find(words[0])) == -1 && n > 1) {
+		(void)snprintf(name, sizeof(name), "%s%s", words[0], words[1]);
+		if ((idx = conf_action_find(name)) != -1)
+			used = 2;
+	}
+	if (idx == -1 && n == 1) {
+		/* "group3": a trailing number is the parameter. */
+		len = strlen(words[0]);
+		while (len > 0 && isdigit((unsigned char)words[0][len - 1]))
+			len--;
+		if (len > 0 && words[0][len] != '\0') {
+			(void)strlcpy(name, words[0], MIN(len + 1, sizeof(name)));
+			idx = conf_action_find(name);
+			if (idx != -1 && name_to_func[idx].param !=
+			    CWM_PARAM_GROUP)
+				idx = -1;
+			param = words[0] + len;
+		}
+	}
+	if (idx == -1)
+		return(0);
+
+	nf = &name_to_func[idx];
+	if (nf->param == CWM_PARAM_NONE) {
+		/* "terminal -e foo" or "lock -n" is a command line. */
+		if (used < n)
+			return(0);
+	} else {
+		if (param == NULL && used < n)
+			param = words[used++];
+		if (used < n) {
+			log_debug("%s: '%s': too many parameters", __func__,
+			    cmd);
+			return(-1);
+		}
+	}
+
+	b->callback = nf->handler;
+	b->flags = nf->flags;
+	b->argument = nf->argument;
+	b->action = idx;
+
+	switch (nf->param) {
+	case CWM_PARAM_NONE:
+		break;
+	case CWM_PARAM_GROUP:
+		if (param == NULL) {
+			log_debug("%s: '%s' needs a group", __func__, nf->tag);
+			return(-1);
+		}
+		num = strtonum(param, 0, CALMWM_NGROUPS - 1, &errstr);
+		if (errstr != NULL) {
+			log_debug("%s: group '%s' is %s", __func__, param,
+			    errstr);
+			return(-1);
+		}
+		b->argument.i = num;
+		break;
+	case CWM_PARAM_AMOUNT:
+		if (param == NULL)
+			break;
+		num = strtonum(param, 1, SHRT_MAX, &errstr);
+		if (errstr != NULL) {
+			log_debug("%s: amount '%s' is %s", __func__, param,
+			    errstr);
+			return(-1);
+		}
+		b->argument.p.n = num;
+		break;
+	}
+
+	return(1);
+}
+
 int
 conf_cmd_add(const char *name, const char *path)
 {
 	struct cmd	*cmd;
 
-	cmd = xcalloc(1, sizeof *cmd);
+	if (strlen(path) >= PATH_MAX)
+		return(0);
 
+	cmd = xcalloc(1, sizeof *cmd);
 	cmd->name = xstrdup(name);
-	if (strlcpy(cmd->path, path, sizeof(cmd->path)) >= sizeof(cmd->path)) {
-		free(cmd->name);
-		free(cmd);
-		return(0);
-	}
+	cmd->path = xstrdup(path);
 
 	conf_cmd_remove(name);
 
@@ -205,49 +319,22 @@ conf_cmd_remove(const char *name)
 		if (strcmp(cmd->name, name) == 0) {
 			TAILQ_REMOVE(&cmdq, cmd, entry);
 			free(cmd->name);
+			free(cmd->path);
 			free(cmd);
 		}
 	}
 }
 
 void
-conf_autogroup(int num, const char *name, const char *class)
+conf_autogroup(struct match *m, int num)
 {
-	struct autogroupwin	*aw;
-	char			*p;
-
-	aw = xmalloc(sizeof(*aw));
-
-	if ((p = strchr(class, ',')) == NULL) {
-		if (name == NULL)
-			aw->name = NULL;
-		else
-			aw->name = xstrdup(name);
-
-		aw->class = xstrdup(class);
-	} else {
-		*(p++) = '\0';
-
-		if (name == NULL)
-			aw->name = xstrdup(class);
-		else
-			aw->name = xstrdup(name);
-
-		aw->class = xstrdup(p);
-	}
-	aw->num = num;
-
-	TAILQ_INSERT_TAIL(&autogroupq, aw, entry);
+	m->group = num;
 }
 
 void
-conf_ignore(const char *name)
+conf_ignore(struct match *m)
 {
-	struct winname	*wn;
-
-	wn = xmalloc(sizeof(*wn));
-	wn->name = xstrdup(name);
-	TAILQ_INSERT_TAIL(&ignoreq, wn, entry);
+	m->ignore = 1;
 }
 
 void
@@ -255,6 +342,7 @@ conf_screen(struct screen_ctx *sc, struct group_ctx *gc)
 {
 	unsigned int		 i;
 	XftColor		 xc;
+	XSetWindowAttributes	 attr;
 	Colormap		 colormap = DefaultColormap(X_Dpy, sc->which);
 	Visual			*visual = DefaultVisual(X_Dpy, sc->which);
 	struct config_group	*cgrp = gc->config_group;
@@ -300,6 +388,19 @@ conf_screen(struct screen_ctx *sc, struct group_ctx *gc)
 			log_fatal("XftDrawCreate() failed");
 	}
 
+	if (sc->geomwin == None) {
+		attr.override_redirect = True;
+		attr.background_pixel = cgrp->xftcolor[CWM_COLOR_MENU_BG].pixel;
+		attr.border_pixel = cgrp->xftcolor[CWM_COLOR_MENU_FG].pixel;
+		sc->geomwin = XCreateWindow(X_Dpy, sc->rootwin, 0, 0, 1, 1,
+		    cgrp->bwidth, CopyFromParent, InputOutput, CopyFromParent,
+		    CWOverrideRedirect | CWBackPixel | CWBorderPixel, &attr);
+		sc->geomdraw = XftDrawCreate(X_Dpy, sc->geomwin, visual,
+		    colormap);
+		if (sc->geomdraw == NULL)
+			log_fatal("XftDrawCreate() failed");
+	}
+
 	conf_cursor(sc);
 }
 
@@ -312,13 +413,12 @@ conf_init(void)
 void
 conf_clear(void)
 {
-	struct autogroupwin	*aw, *aw_tmp;
 	struct binding		*kb, *mb, *bind_tmp;
-	struct winname		*wn, *wn_tmp;
 	struct cmd		*cmd, *cmd_tmp;
 
 	TAILQ_FOREACH_SAFE(cmd, &cmdq, entry, cmd_tmp) {
 		free(cmd->name);
+		free(cmd->path);
 		TAILQ_REMOVE(&cmdq, cmd, entry);
 		free(cmd);
 	}
@@ -328,25 +428,15 @@ conf_clear(void)
 		free(kb);
 	}
 
-	TAILQ_FOREACH_SAFE(aw, &autogroupq, entry, aw_tmp) {
-		free(aw->class);
-		free(aw->name);
-		TAILQ_REMOVE(&autogroupq, aw, entry);
-		free(aw);
-	}
-
-	TAILQ_FOREACH_SAFE(wn, &ignoreq, entry, wn_tmp) {
-		free(wn->name);
-		TAILQ_REMOVE(&ignoreq, wn, entry);
-		free(wn);
-	}
+	match_clear();
 
 	TAILQ_FOREACH_SAFE(mb, &mousebindingq, entry, bind_tmp) {
 		TAILQ_REMOVE(&mousebindingq, mb, entry);
 		free(mb);
 	}
 
-	xu_key_ungrab(RootWindow(X_Dpy, DefaultScreen(X_Dpy)));
+	xu_key_ungrab_all(RootWindow(X_Dpy, DefaultScreen(X_Dpy)),
+	    &keygrabs);
 
 	/* FIXME: free() colors here. */
 }
@@ -354,7 +444,8 @@ conf_clear(void)
 void
 conf_client(struct client_ctx *cc)
 {
-	struct winname		*wn;
+	struct match		**matches;
+	size_t			 i, n;
 	bool			 ignore = false;
 
 	if (cc->group == NULL) {
@@ -364,8 +455,9 @@ conf_client(struct client_ctx *cc)
 
 	cc->bwidth = cc->group->config_group->bwidth;
 
-	TAILQ_FOREACH(wn, &ignoreq, entry) {
-		if (strcmp(wn->name, cc->name) == 0) {
+	matches = match_client(cc, &n);
+	for (i = 0; i < n; i++) {
+		if (matches[i]->ignore) {
 			ignore = true;
 			break;
 		}
@@ -403,7 +495,6 @@ conf_bind_kbd(const char *bind, const char *cmd)
 {
 	struct binding	*kb;
 	const char	*key;
-	unsigned int	 i;
 
 	kb = xcalloc(1, sizeof(*kb));
 	key = conf_bind_getmask(bind, &kb->modmask);
@@ -425,21 +516,18 @@ conf_bind_kbd(const char *bind, const char *cmd)
 		return(1);
 	}
 
-	for (i = 0; i < nitems(name_to_func); i++) {
-		if (name_to_func[i].tag == NULL)
-			break;
-		if (strcmp(name_to_func[i].tag, cmd) != 0)
-			continue;
-
-		kb->callback = name_to_func[i].handler;
-		kb->flags = name_to_func[i].flags;
-		kb->argument = name_to_func[i].argument;
+	switch (conf_action_parse(cmd, kb)) {
+	case 1:
 		TAILQ_INSERT_TAIL(&keybindingq, kb, entry);
 		return(1);
+	case -1:
+		free(kb);
+		return(0);
 	}
 
 	kb->callback = kbfunc_cmdexec;
 	kb->flags = CWM_CMD;
+	kb->action = -1;
 	kb->argument.c = xstrdup(cmd);
 	TAILQ_INSERT_TAIL(&keybindingq, kb, entry);
 	return(1);
@@ -470,9 +558,8 @@ conf_bind_mouse(const char *bind, const char *cmd)
 {
 	struct binding	*mb;
 	const char	*button, *errstr;
-	unsigned int	 i;
 
-	mb = xmalloc(sizeof(*mb));
+	mb = xcalloc(1, sizeof(*mb));
 	button = conf_bind_getmask(bind, &mb->modmask);
 
 	mb->press.button = strtonum(button, Button1, Button5, &errstr);
@@ -490,18 +577,14 @@ conf_bind_mouse(const char *bind, const char *cmd)
 		return(1);
 	}
 
-	for (i = 0; i < nitems(name_to_func); i++) {
-		if (strcmp(name_to_func[i].tag, cmd) != 0)
-			continue;
-
-		mb->callback = name_to_func[i].handler;
-		mb->flags = name_to_func[i].flags;
-		mb->argument = name_to_func[i].argument;
-		TAILQ_INSERT_TAIL(&mousebindingq, mb, entry);
-		return(1);
+	if (conf_action_parse(cmd, mb) != 1) {
+		log_debug("%s: unknown mouse action '%s'", __func__, cmd);
+		free(mb);
+		return(0);
 	}
+	TAILQ_INSERT_TAIL(&mousebindingq, mb, entry);
 
-	return(0);
+	return(1);
 }
 
 static void
@@ -539,29 +622,36 @@ conf_cursor(struct screen_ctx *sc)
 }
 
 void
-conf_grab_mouse(Window win)
+conf_grab_mouse(struct client_ctx *cc)
 {
+	struct grab_set	 want = { NULL, 0 };
 	struct binding	*mb;
 
-	xu_btn_ungrab(win);
-
 	TAILQ_FOREACH(mb, &mousebindingq, entry) {
 		if (mb->flags & CWM_WIN)
-			xu_btn_grab(win, mb->modmask, mb->press.button);
+			xu_grab_add(&want, mb->press.button, mb->modmask);
 	}
+	xu_grab_update(cc->win, &cc->btngrabs, &want, GRAB_BTN);
 }
 
 void
 conf_grab_kbd(Window win)
 {
+	struct grab_set	 want = { NULL, 0 };
 	struct binding	*kb;
-
-	XGrabServer(X_Dpy);
-	xu_key_ungrab(win);
-
-	TAILQ_FOREACH(kb, &keybindingq, entry)
-		xu_key_grab(win, kb->modmask, kb->press.keysym);
-	XUngrabServer(X_Dpy);
+	unsigned int	 mask;
+	KeyCode		 code;
+
+	TAILQ_FOREACH(kb, &keybindingq, entry) {
+		mask = kb->modmask;
+		if ((code = xu_key_resolve(kb->press.keysym, &mask)) == 0) {
+			log_debug("%s: keysym 0x%lx isn't mapped", __func__,
+			    kb->press.keysym);
+			continue;
+		}
+		xu_grab_add(&want, code, mask);
+	}
+	xu_grab_update(win, &keygrabs, &want, GRAB_KEY);
 }
 
 static char *cwmhints[] = {
@@ -592,6 +682,9 @@ static char *ewmhints[] = {
 	"_NET_WM_NAME",
 	"_NET_WM_DESKTOP",
 	"_NET_CLOSE_WINDOW",
+	"_NET_WM_WINDOW_TYPE",
+	"_NET_WM_SYNC_REQUEST",
+	"_NET_WM_SYNC_REQUEST_COUNTER",
 	"_NET_WM_STATE",
 	"_NET_WM_STATE_STICKY",
 	"_NET_WM_STATE_MAXIMIZED_VERT",
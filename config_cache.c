@@ -0,0 +1,745 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Copyright (c) 2017 Thomas Adam <thomas@xteddy.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A compiled form of the resolved configuration.
+ *
+ * Once the rc file has been parsed and internalised, everything which was
+ * resolved from it (bindings with their keysyms and actions, autogroups,
+ * ignores, rules, menu commands, and the per-screen/per-group settings) is
+ * written to a flat file under $XDG_CACHE_HOME.  On the next start, if the
+ * rc file's mtime, size and content hash, and the compiled-in defaults,
+ * still match what was recorded, that file is mmap'd and loaded directly
+ * instead of going through libconfuse again.  Anything unexpected means a
+ * full parse.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+#define CACHE_MAGIC	0x63776d63	/* "cwmc" */
+#define CACHE_VERSION	6
+#define CACHE_NOSTR	UINT32_MAX
+
+enum cache_rec {
+	CACHE_REC_KEY,
+	CACHE_REC_MOUSE,
+	CACHE_REC_CMD,
+	CACHE_REC_MATCH,
+	CACHE_REC_RULE,
+	CACHE_REC_SCREEN,
+	CACHE_REC_GROUP,
+	CACHE_REC_END
+};
+
+struct cache_hdr {
+	uint32_t	 magic;
+	uint32_t	 version;
+	uint64_t	 rc_mtime;
+	uint64_t	 rc_size;
+	uint64_t	 rc_hash;
+	uint64_t	 act_hash;
+	uint64_t	 def_hash;
+	uint64_t	 scr_hash;
+	uint64_t	 body_hash;
+	uint64_t	 body_len;
+};
+
+struct cache_buf {
+	unsigned char	*data;
+	size_t		 len;
+	size_t		 size;
+};
+
+struct cache_reader {
+	const unsigned char	*p;
+	const unsigned char	*end;
+	int			 error;
+};
+
+/*
+ * Screen and group settings are read into these and only applied once the
+ * whole file has been read, so a bad cache leaves them as they were.
+ */
+struct cache_screen {
+	struct screen_ctx	*sc;
+	struct config_screen	 cs;
+};
+
+struct cache_group {
+	struct group_ctx	*gc;
+	int			 bwidth;
+	char			*color[CWM_COLOR_NITEMS];
+};
+
+struct cache_pending {
+	struct cache_screen	*scr;
+	size_t			 nscr;
+	struct cache_group	*grp;
+	size_t			 ngrp;
+};
+
+static char		*config_cache_path(void);
+static int		 config_cache_rc_info(struct cache_hdr *,
+			     const struct cache_hdr *);
+static uint64_t		 config_cache_act_hash(void);
+static uint64_t		 config_cache_scr_hash(void);
+static int		 config_cache_action_valid(int);
+static void		 cache_put(struct cache_buf *, const void *, size_t);
+static void		 cache_put_int(struct cache_buf *, int);
+static void		 cache_put_str(struct cache_buf *, const char *);
+static void		 cache_get(struct cache_reader *, void *, size_t);
+static int		 cache_get_int(struct cache_reader *);
+static char		*cache_get_str(struct cache_reader *);
+static void		 cache_put_action(struct cache_buf *, struct binding *);
+static void		 cache_get_action(struct cache_reader *,
+			     struct binding *);
+static int		 config_cache_read(struct cache_reader *);
+static void		 config_cache_apply(struct cache_pending *);
+static void		 config_cache_discard(struct cache_pending *);
+
+static char *
+config_cache_path(void)
+{
+	char	 name[64];
+
+	/* One cache per rc file, so -c doesn't thrash the default one. */
+	(void)snprintf(name, sizeof(name), "cwm-new-%016llx.cache",
+	    (unsigned long long)u_hash(conf_path, strlen(conf_path), 0));
+
+	return(u_cache_path(name));
+}
+
+/*
+ * Fill in the rc file's identity: mtime, size and content hash.  If old is
+ * given and the mtime or size already differ from it, return 1 without
+ * reading the file.
+ */
+static int
+config_cache_rc_info(struct cache_hdr *hdr, const struct cache_hdr *old)
+{
+	struct stat	 sb;
+	void		*map;
+	int		 fd;
+
+	if ((fd = open(conf_path, O_RDONLY)) == -1)
+		return(-1);
+	if (fstat(fd, &sb) == -1) {
+		close(fd);
+		return(-1);
+	}
+
+	hdr->rc_mtime = sb.st_mtime;
+	hdr->rc_size = sb.st_size;
+	if (old != NULL && (hdr->rc_mtime != old->rc_mtime ||
+	    hdr->rc_size != old->rc_size)) {
+		close(fd);
+		return(1);
+	}
+
+	hdr->rc_hash = u_hash(NULL, 0, 0);
+
+	if (sb.st_size > 0) {
+		map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return(-1);
+		}
+		hdr->rc_hash = u_hash(map, sb.st_size, 0);
+		munmap(map, sb.st_size);
+	}
+	close(fd);
+
+	return(0);
+}
+
+/*
+ * Actions are stored as indices into name_to_func[], so any change to that
+ * table has to invalidate the cache.
+ */
+static uint64_t
+config_cache_act_hash(void)
+{
+	const struct name_func	*nf;
+	uint64_t		 h = u_hash(NULL, 0, 0);
+
+	for (nf = name_to_func; nf->tag != NULL; nf++)
+		h = u_hash(nf->tag, strlen(nf->tag) + 1, h);
+
+	return(h);
+}
+
+/* Screen config is keyed by output name; the set of outputs must match. */
+static uint64_t
+config_cache_scr_hash(void)
+{
+	struct screen_ctx	*sc;
+	uint64_t		 h = u_hash(NULL, 0, 0);
+
+	TAILQ_FOREACH(sc, &Screenq, entry)
+		h = u_hash(sc->name, strlen(sc->name) + 1, h);
+
+	return(h);
+}
+
+static int
+config_cache_action_valid(int idx)
+{
+	int	 i;
+
+	if (idx < 0)
+		return(0);
+	for (i = 0; name_to_func[i].tag != NULL; i++) {
+		if (i == idx)
+			return(1);
+	}
+
+	return(0);
+}
+
+static void
+cache_put(struct cache_buf *cb, const void *p, size_t len)
+{
+	if (cb->len + len > cb->size) {
+		while (cb->len + len > cb->size)
+			cb->size = cb->size ? cb->size * 2 : 4096;
+		cb->data = xreallocarray(cb->data, cb->size, 1);
+	}
+	memcpy(cb->data + cb->len, p, len);
+	cb->len += len;
+}
+
+static void
+cache_put_int(struct cache_buf *cb, int i)
+{
+	int32_t	 v = i;
+
+	cache_put(cb, &v, sizeof(v));
+}
+
+static void
+cache_put_str(struct cache_buf *cb, const char *s)
+{
+	uint32_t	 len;
+
+	if (s == NULL) {
+		len = CACHE_NOSTR;
+		cache_put(cb, &len, sizeof(len));
+		return;
+	}
+	len = strlen(s);
+	cache_put(cb, &len, sizeof(len));
+	cache_put(cb, s, len);
+}
+
+static void
+cache_get(struct cache_reader *cr, void *p, size_t len)
+{
+	if (cr->error || (size_t)(cr->end - cr->p) < len) {
+		cr->error = 1;
+		memset(p, 0, len);
+		return;
+	}
+	memcpy(p, cr->p, len);
+	cr->p += len;
+}
+
+static int
+cache_get_int(struct cache_reader *cr)
+{
+	int32_t	 v;
+
+	cache_get(cr, &v, sizeof(v));
+	return(v);
+}
+
+static char *
+cache_get_str(struct cache_reader *cr)
+{
+	uint32_t	 len;
+	char		*s;
+
+	cache_get(cr, &len, sizeof(len));
+	if (cr->error || len == CACHE_NOSTR)
+		return(NULL);
+	if ((size_t)(cr->end - cr->p) < len) {
+		cr->error = 1;
+		return(NULL);
+	}
+	s = xmalloc(len + 1);
+	memcpy(s, cr->p, len);
+	s[len] = '\0';
+	cr->p += len;
+
+	return(s);
+}
+
+/* An action is its index plus whatever parameter it was given. */
+static void
+cache_put_action(struct cache_buf *cb, struct binding *b)
+{
+	cache_put_int(cb, b->action);
+	cache_put_int(cb, b->argument.p.flags);
+	cache_put_int(cb, b->argument.p.n);
+}
+
+static void
+cache_get_action(struct cache_reader *cr, struct binding *b)
+{
+	int	 idx;
+
+	idx = cache_get_int(cr);
+	b->argument.p.flags = cache_get_int(cr);
+	b->argument.p.n = cache_get_int(cr);
+	if (cr->error || !config_cache_action_valid(idx)) {
+		cr->error = 1;
+		return;
+	}
+	b->callback = name_to_func[idx].handler;
+	b->flags = name_to_func[idx].flags;
+	b->action = idx;
+}
+
+void
+config_cache_save(void)
+{
+	struct cache_hdr	 hdr;
+	struct cache_buf	 cb;
+	struct binding		*b;
+	struct cmd		*cmd;
+	struct match		*m;
+	struct rule		*rule;
+	struct rule_item	*ri;
+	struct screen_ctx	*sc;
+	struct group_ctx	*gc;
+	struct config_screen	*cscr;
+	struct config_group	*cgrp;
+	char			*path, *tmp;
+	int			 fd, i;
+
+	if (conf_path == NULL)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	if (config_cache_rc_info(&hdr, NULL) == -1)
+		return;
+	if ((path = config_cache_path()) == NULL)
+		return;
+
+	memset(&cb, 0, sizeof(cb));
+
+	TAILQ_FOREACH(b, &keybindingq, entry) {
+		cache_put_int(&cb, CACHE_REC_KEY);
+		cache_put_int(&cb, b->modmask);
+		cache_put_int(&cb, b->press.keysym);
+		if (b->flags & CWM_CMD) {
+			cache_put_int(&cb, -1);
+			cache_put_str(&cb, b->argument.c);
+		} else {
+			cache_put_int(&cb, 0);
+			cache_put_action(&cb, b);
+		}
+	}
+
+	TAILQ_FOREACH(b, &mousebindingq, entry) {
+		cache_put_int(&cb, CACHE_REC_MOUSE);
+		cache_put_int(&cb, b->modmask);
+		cache_put_int(&cb, b->press.button);
+		cache_put_action(&cb, b);
+	}
+
+	TAILQ_FOREACH(cmd, &cmdq, entry) {
+		cache_put_int(&cb, CACHE_REC_CMD);
+		cache_put_str(&cb, cmd->name);
+		cache_put_str(&cb, cmd->path);
+	}
+
+	TAILQ_FOREACH(m, &matchq, entry) {
+		cache_put_int(&cb, CACHE_REC_MATCH);
+		cache_put_int(&cb, m->id);
+		for (i = 0; i < MATCH_NFIELDS; i++)
+			cache_put_str(&cb, m->pat[i].str);
+		cache_put_int(&cb, m->group);
+		cache_put_int(&cb, m->ignore);
+	}
+
+	TAILQ_FOREACH(rule, &ruleq, entry) {
+		TAILQ_FOREACH(ri, &rule->rule_item, entry) {
+			cache_put_int(&cb, CACHE_REC_RULE);
+			cache_put_int(&cb, rule->match->id);
+			cache_put_str(&cb, rule->rule_name);
+			cache_put_str(&cb, ri->name);
+			cache_put_action(&cb, ri->b);
+		}
+	}
+
+	TAILQ_FOREACH(sc, &Screenq, entry) {
+		cscr = sc->config_screen;
+
+		cache_put_int(&cb, CACHE_REC_SCREEN);
+		cache_put_str(&cb, sc->name);
+		cache_put_int(&cb, cscr->gap.top);
+		cache_put_int(&cb, cscr->gap.bottom);
+		cache_put_int(&cb, cscr->gap.left);
+		cache_put_int(&cb, cscr->gap.right);
+		cache_put_int(&cb, cscr->snapdist);
+		cache_put_int(&cb, cscr->fuzzy);
+		cache_put_int(&cb, cscr->outline);
+		cache_put_str(&cb, cscr->font);
+		cache_put_str(&cb, cscr->panel_cmd);
+
+		TAILQ_FOREACH(gc, &sc->groupq, entry) {
+			cgrp = gc->config_group;
+
+			cache_put_int(&cb, CACHE_REC_GROUP);
+			cache_put_int(&cb, gc->num);
+			cache_put_int(&cb, cgrp->bwidth);
+			for (i = 0; i < CWM_COLOR_NITEMS; i++)
+				cache_put_str(&cb, cgrp->color[i]);
+		}
+	}
+	cache_put_int(&cb, CACHE_REC_END);
+
+	hdr.magic = CACHE_MAGIC;
+	hdr.version = CACHE_VERSION;
+	hdr.act_hash = config_cache_act_hash();
+	hdr.def_hash = config_default_hash();
+	hdr.scr_hash = config_cache_scr_hash();
+	hdr.body_len = cb.len;
+	hdr.body_hash = u_hash(cb.data, cb.len, 0);
+
+	/* Write then rename, so a concurrent start never sees half a file. */
+	xasprintf(&tmp, "%s.%d", path, (int)getpid());
+	if ((fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0600)) == -1) {
+		log_debug("%s: open %s: %s", __func__, tmp, strerror(errno));
+		goto out;
+	}
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    write(fd, cb.data, cb.len) != (ssize_t)cb.len) {
+		log_debug("%s: write %s: %s", __func__, tmp, strerror(errno));
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+	close(fd);
+
+	if (rename(tmp, path) == -1) {
+		log_debug("%s: rename %s: %s", __func__, path, strerror(errno));
+		unlink(tmp);
+	} else
+		log_debug("%s: wrote %zu bytes to %s", __func__, cb.len, path);
+out:
+	free(tmp);
+	free(path);
+	free(cb.data);
+}
+
+static int
+config_cache_read(struct cache_reader *cr)
+{
+	struct binding		*b;
+	struct match		*m;
+	struct screen_ctx	*sc = NULL;
+	struct group_ctx	*gc;
+	struct cache_pending	 pend;
+	struct cache_screen	*cs;
+	struct cache_group	*cg;
+	char			*s1, *s2, *pat[MATCH_NFIELDS];
+	int			 type, num, i;
+
+	memset(&pend, 0, sizeof(pend));
+
+	while (!cr->error) {
+		type = cache_get_int(cr);
+		switch (type) {
+		case CACHE_REC_KEY:
+			b = xcalloc(1, sizeof(*b));
+			b->modmask = cache_get_int(cr);
+			b->press.keysym = (unsigned int)cache_get_int(cr);
+			if (cache_get_int(cr) == -1) {
+				b->callback = kbfunc_cmdexec;
+				b->flags = CWM_CMD;
+				b->action = -1;
+				if ((b->argument.c = cache_get_str(cr)) == NULL)
+					cr->error = 1;
+			} else
+				cache_get_action(cr, b);
+			if (cr->error) {
+				free(b);
+				break;
+			}
+			TAILQ_INSERT_TAIL(&keybindingq, b, entry);
+			break;
+		case CACHE_REC_MOUSE:
+			b = xcalloc(1, sizeof(*b));
+			b->modmask = cache_get_int(cr);
+			b->press.button = cache_get_int(cr);
+			cache_get_action(cr, b);
+			if (cr->error) {
+				free(b);
+				break;
+			}
+			TAILQ_INSERT_TAIL(&mousebindingq, b, entry);
+			break;
+		case CACHE_REC_CMD:
+			s1 = cache_get_str(cr);
+			s2 = cache_get_str(cr);
+			if (s1 != NULL && s2 != NULL)
+				conf_cmd_add(s1, s2);
+			else
+				cr->error = 1;
+			free(s1);
+			free(s2);
+			break;
+		case CACHE_REC_MATCH:
+			/* Ids are handed out in order; check that they agree. */
+			num = cache_get_int(cr);
+			for (i = 0; i < MATCH_NFIELDS; i++)
+				pat[i] = cache_get_str(cr);
+			m = NULL;
+			if (!cr->error)
+				m = match_add(pat[MATCH_CLASS],
+				    pat[MATCH_INSTANCE], pat[MATCH_TITLE],
+				    pat[MATCH_TYPE]);
+			for (i = 0; i < MATCH_NFIELDS; i++)
+				free(pat[i]);
+			if (m == NULL || m->id != num) {
+				cr->error = 1;
+				break;
+			}
+			m->group = cache_get_int(cr);
+			m->ignore = cache_get_int(cr);
+			break;
+		case CACHE_REC_RULE:
+			m = match_find_by_index(cache_get_int(cr));
+			s1 = cache_get_str(cr);
+			s2 = cache_get_str(cr);
+			b = xcalloc(1, sizeof(*b));
+			cache_get_action(cr, b);
+			if (!cr->error && m != NULL && s1 != NULL &&
+			    s2 != NULL)
+				rule_add(m, s1, s2, b);
+			else {
+				free(b);
+				cr->error = 1;
+			}
+			free(s1);
+			free(s2);
+			break;
+		case CACHE_REC_SCREEN:
+			if ((s1 = cache_get_str(cr)) == NULL) {
+				cr->error = 1;
+				break;
+			}
+			sc = screen_find_by_name(s1);
+			free(s1);
+			if (sc == NULL) {
+				cr->error = 1;
+				break;
+			}
+			pend.scr = xreallocarray(pend.scr, pend.nscr + 1,
+			    sizeof(*pend.scr));
+			cs = &pend.scr[pend.nscr++];
+			memset(cs, 0, sizeof(*cs));
+			cs->sc = sc;
+			cs->cs.gap.top = cache_get_int(cr);
+			cs->cs.gap.bottom = cache_get_int(cr);
+			cs->cs.gap.left = cache_get_int(cr);
+			cs->cs.gap.right = cache_get_int(cr);
+			cs->cs.snapdist = cache_get_int(cr);
+			cs->cs.fuzzy = cache_get_int(cr);
+			cs->cs.outline = cache_get_int(cr);
+			cs->cs.font = cache_get_str(cr);
+			cs->cs.panel_cmd = cache_get_str(cr);
+			if (cs->cs.font == NULL)
+				cr->error = 1;
+			break;
+		case CACHE_REC_GROUP:
+			num = cache_get_int(cr);
+			if (sc == NULL || cr->error) {
+				cr->error = 1;
+				break;
+			}
+			TAILQ_FOREACH(gc, &sc->groupq, entry) {
+				if (gc->num == num)
+					break;
+			}
+			if (gc == NULL) {
+				cr->error = 1;
+				break;
+			}
+			pend.grp = xreallocarray(pend.grp, pend.ngrp + 1,
+			    sizeof(*pend.grp));
+			cg = &pend.grp[pend.ngrp++];
+			cg->gc = gc;
+			cg->bwidth = cache_get_int(cr);
+			for (i = 0; i < CWM_COLOR_NITEMS; i++)
+				cg->color[i] = cache_get_str(cr);
+			break;
+		case CACHE_REC_END:
+			if (cr->p != cr->end) {
+				cr->error = 1;
+				break;
+			}
+			config_cache_apply(&pend);
+			return(0);
+		default:
+			cr->error = 1;
+			break;
+		}
+	}
+
+	config_cache_discard(&pend);
+	return(-1);
+}
+
+/* Hand the screen and group settings over; they now own the strings. */
+static void
+config_cache_apply(struct cache_pending *pend)
+{
+	struct config_screen	*cscr;
+	struct config_group	*cgrp;
+	size_t			 n;
+	int			 i;
+
+	for (n = 0; n < pend->nscr; n++) {
+		cscr = pend->scr[n].sc->config_screen;
+		cscr->gap = pend->scr[n].cs.gap;
+		cscr->snapdist = pend->scr[n].cs.snapdist;
+		cscr->fuzzy = pend->scr[n].cs.fuzzy;
+		cscr->outline = pend->scr[n].cs.outline;
+		free(cscr->font);
+		cscr->font = pend->scr[n].cs.font;
+		free(cscr->panel_cmd);
+		cscr->panel_cmd = pend->scr[n].cs.panel_cmd;
+	}
+	for (n = 0; n < pend->ngrp; n++) {
+		cgrp = pend->grp[n].gc->config_group;
+		cgrp->bwidth = pend->grp[n].bwidth;
+		for (i = 0; i < CWM_COLOR_NITEMS; i++) {
+			free(cgrp->color[i]);
+			cgrp->color[i] = pend->grp[n].color[i];
+		}
+	}
+	free(pend->scr);
+	free(pend->grp);
+}
+
+static void
+config_cache_discard(struct cache_pending *pend)
+{
+	size_t	 n;
+	int	 i;
+
+	for (n = 0; n < pend->nscr; n++) {
+		free(pend->scr[n].cs.font);
+		free(pend->scr[n].cs.panel_cmd);
+	}
+	for (n = 0; n < pend->ngrp; n++) {
+		for (i = 0; i < CWM_COLOR_NITEMS; i++)
+			free(pend->grp[n].color[i]);
+	}
+	free(pend->scr);
+	free(pend->grp);
+}
+
+/*
+ * Load the resolved configuration from the cache, if it's still valid for
+ * the rc file on disk.  Returns 0 on success; -1 means the caller has to
+ * parse the rc file itself.
+ */
+int
+config_cache_load(void)
+{
+	struct cache_hdr	 hdr, cur;
+	struct cache_reader	 cr;
+	struct stat		 sb;
+	unsigned char		*map = MAP_FAILED;
+	char			*path;
+	int			 fd = -1, ret = -1, i;
+
+	if (conf_path == NULL)
+		return(-1);
+	if ((path = config_cache_path()) == NULL)
+		return(-1);
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		goto out;
+	if (fstat(fd, &sb) == -1 || sb.st_size < (off_t)sizeof(hdr))
+		goto out;
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		goto out;
+	memcpy(&hdr, map, sizeof(hdr));
+
+	if (hdr.magic != CACHE_MAGIC || hdr.version != CACHE_VERSION ||
+	    hdr.body_len != (uint64_t)sb.st_size - sizeof(hdr)) {
+		log_debug("%s: %s is stale or not a cache", __func__, path);
+		goto out;
+	}
+
+	/* Cheap checks first, so an edited file never gets hashed. */
+	memset(&cur, 0, sizeof(cur));
+	if ((i = config_cache_rc_info(&cur, &hdr)) == -1)
+		goto out;
+	if (i == 1 || cur.rc_hash != hdr.rc_hash) {
+		log_debug("%s: %s has changed", __func__, conf_path);
+		goto out;
+	}
+	if (hdr.act_hash != config_cache_act_hash() ||
+	    hdr.def_hash != config_default_hash() ||
+	    hdr.scr_hash != config_cache_scr_hash()) {
+		log_debug("%s: actions, defaults or outputs have changed",
+		    __func__);
+		goto out;
+	}
+	if (u_hash(map + sizeof(hdr), hdr.body_len, 0) != hdr.body_hash) {
+		log_debug("%s: %s is corrupt", __func__, path);
+		goto out;
+	}
+
+	cr.p = map + sizeof(hdr);
+	cr.end = map + sb.st_size;
+	cr.error = 0;
+	if ((ret = config_cache_read(&cr)) == -1) {
+		/* Throw away whatever was loaded; a full parse follows. */
+		log_debug("%s: %s is malformed", __func__, path);
+		conf_clear();
+		rule_clear();
+	}
+out:
+	if (map != MAP_FAILED)
+		munmap(map, sb.st_size);
+	if (fd != -1)
+		close(fd);
+	free(path);
+
+	return(ret);
+}
@@ -38,6 +38,8 @@ static void	 config_intern_group(struct config_group *, cfg_t *);
 static void	 config_intern_screen(struct config_screen *, cfg_t *);
 static void	 config_intern_bindings(cfg_t *);
 static void	 config_intern_menu(cfg_t *);
+static uint64_t	 config_opts_hash(cfg_opt_t *, uint64_t);
+static int	 config_client_split(char *, char **);
 
 cfg_opt_t	 color_opts[] = {
 	CFG_STR("activeborder", "#CCCCCC", CFGF_NONE),
@@ -103,6 +105,8 @@ cfg_opt_t	 rules_item_opts[] = {
 cfg_opt_t	 client_item_opts[] = {
 	CFG_BOOL("ignore", cfg_false, CFGF_NONE),
 	CFG_STR("autogroup", NULL, CFGF_NONE),
+	CFG_STR("title", NULL, CFGF_NONE),
+	CFG_STR("window-type", NULL, CFGF_NONE),
 	CFG_SEC("rules", rules_item_opts, CFGF_MULTI),
 	CFG_END()
 };
@@ -193,6 +197,8 @@ cfg_opt_t	 screen_opts[] = {
 	CFG_INT("snapdist", 0, CFGF_NONE),
 	CFG_STR("font", CONF_FONT, CFGF_NONE),
 	CFG_STR("panel-cmd", NULL, CFGF_NONE),
+	CFG_STR_LIST("fuzzy-menus", "{}", CFGF_NONE),
+	CFG_STR_LIST("outline", "{}", CFGF_NONE),
 	CFG_END()
 };
 
@@ -352,12 +358,55 @@ config_default(cfg_t *cfg, int flag)
 	}
 }
 
+/*
+ * Split a client's title, "instance,class" or just "class", in place.  A
+ * comma inside a /.../ expression doesn't separate the two.
+ */
+static int
+config_client_split(char *title, char **res)
+{
+	char	*p, *field[2];
+	int	 n = 0;
+
+	field[n++] = p = title;
+	for (;;) {
+		if (*p == '/') {
+			/* Skip to the closing slash, if it ends the field. */
+			for (p++; *p != '\0' && *p != '/'; p++) {
+				if (*p == '\\' && p[1] != '\0')
+					p++;
+			}
+			if (*p == '/' && (p[1] == ',' || p[1] == '\0'))
+				p++;
+		}
+		p += strcspn(p, ",");
+		if (*p == '\0')
+			break;
+		if (n == 2)
+			return(-1);
+		*p++ = '\0';
+		field[n++] = p;
+	}
+
+	if (n == 2) {
+		res[0] = field[0];
+		res[1] = field[1];
+	} else {
+		/* Just the class. */
+		res[0] = NULL;
+		res[1] = field[0];
+	}
+
+	return(0);
+}
+
 static void
 config_intern_clients(cfg_t *cfg)
 {
 	cfg_t		*clients_sec, *c_sec, *r_sec, *rule_sec;
 	const char	*client_title, *errstr, *rule_title;
-	char		*client_res[2], *tmp, *ctitle, *class_or_res;
+	char		*client_res[2], *ctitle;
+	struct match	*m;
 	char		*grp;
 	int		 t_grp;
 	size_t		 i, j, r, rs;
@@ -369,21 +418,23 @@ config_intern_clients(cfg_t *cfg)
 			c_sec = cfg_getnsec(clients_sec, "client", j);
 
 			client_title = cfg_title(c_sec);
-			ctitle = (char *)client_title;
-
-			if (strchr(client_title, ',') != NULL) {
-				/* This contains both the class and the
-				 * resource.
-				 */
-				tmp = strtok(ctitle, ",");
-				client_res[0] = tmp;
-
-				tmp = strtok(NULL, ",");
-				client_res[1] = tmp;
-			} else {
-				/* Just the class. */
-				client_res[0] = NULL;
-				client_res[1] = ctitle;
+			ctitle = xstrdup(client_title);
+
+			if (config_client_split(ctitle, client_res) == -1) {
+				log_debug("%s: client '%s' has too many "
+				    "fields", __func__, client_title);
+				free(ctitle);
+				continue;
+			}
+
+			m = match_add(client_res[1], client_res[0],
+			    cfg_getstr(c_sec, "title"),
+			    cfg_getstr(c_sec, "window-type"));
+			free(ctitle);
+			if (m == NULL) {
+				log_debug("%s: client '%s' has an invalid "
+				    "pattern", __func__, client_title);
+				continue;
 			}
 
 			if (cfg_getstr(c_sec, "autogroup") != NULL) {
@@ -394,17 +445,14 @@ config_intern_clients(cfg_t *cfg)
 					log_debug("Group '%s' not valid; %s",
 					    grp, errstr);
 				}
-				conf_autogroup(t_grp, client_res[0],
-				    client_res[1]);
+				conf_autogroup(m, t_grp);
 			}
 
 			if (cfg_getbool(c_sec, "ignore"))
-				conf_ignore(client_res[1]);
+				conf_ignore(m);
 
 			/* Process any rules here. */
 			r_sec = cfg_getsec(c_sec, "rules");
-			class_or_res = client_res[0] != NULL ?
-				client_res[0] : client_res[1];
 
 			for (r = 0; r < cfg_size(r_sec, "rule"); r++) {
 				rule_sec = cfg_getnsec(r_sec, "rule", r);
@@ -418,7 +466,7 @@ config_intern_clients(cfg_t *cfg)
 
 				for (rs = 0; rs < cfg_size(rule_sec, "command");
 				    rs++) {
-					rule_config(class_or_res, rule_title,
+					rule_config(m, rule_title,
 					    cfg_getnstr(rule_sec, "command",
 					    rs));
 				}
@@ -552,9 +600,34 @@ config_intern_group(struct config_group *cg, cfg_t *cfg)
 	}
 }
 
+static const struct {
+	const char	*name;
+	int		 flag;
+} fuzzy_menus[] = {
+	{ "all",		~0 },
+	{ "application",	CWM_FUZZY_APPLICATION },
+	{ "exec",		CWM_FUZZY_EXEC },
+	{ "group",		CWM_FUZZY_GROUP },
+	{ "ssh",		CWM_FUZZY_SSH },
+	{ "window",		CWM_FUZZY_WINDOW },
+	{ "wm",			CWM_FUZZY_WM },
+};
+
+static const struct {
+	const char	*name;
+	int		 flag;
+} outline_ops[] = {
+	{ "all",		~0 },
+	{ "move",		CWM_OUTLINE_MOVE },
+	{ "resize",		CWM_OUTLINE_RESIZE },
+};
+
 static void
 config_intern_screen(struct config_screen *cs, cfg_t *cfg)
 {
+	const char	*name;
+	unsigned int	 i, j;
+
 	/* XXX - validation: < 0 > INT_MAX == bad */
 	cs->gap.top = cfg_getnint(cfg, "gap", 0);
 	cs->gap.bottom = cfg_getnint(cfg, "gap", 1);
@@ -563,27 +636,116 @@ config_intern_screen(struct config_screen *cs, cfg_t *cfg)
 
 	/* XXX - validation: < 0 > INT_MAX == bad */
 	cs->snapdist = cfg_getint(cfg, "snapdist");
-	cs->font = cfg_getstr(cfg, "font");
+	free(cs->font);
+	cs->font = xstrdup(cfg_getstr(cfg, "font"));
+	free(cs->panel_cmd);
 	cs->panel_cmd = cfg_getstr(cfg, "panel-cmd");
+	if (cs->panel_cmd != NULL)
+		cs->panel_cmd = xstrdup(cs->panel_cmd);
+
+	cs->fuzzy = 0;
+	for (i = 0; i < cfg_size(cfg, "fuzzy-menus"); i++) {
+		name = cfg_getnstr(cfg, "fuzzy-menus", i);
+		for (j = 0; j < nitems(fuzzy_menus); j++) {
+			if (strcmp(name, fuzzy_menus[j].name) == 0)
+				break;
+		}
+		if (j == nitems(fuzzy_menus)) {
+			log_debug("%s: unknown menu '%s'", __func__, name);
+			continue;
+		}
+		cs->fuzzy |= fuzzy_menus[j].flag;
+	}
+
+	cs->outline = 0;
+	for (i = 0; i < cfg_size(cfg, "outline"); i++) {
+		name = cfg_getnstr(cfg, "outline", i);
+		for (j = 0; j < nitems(outline_ops); j++) {
+			if (strcmp(name, outline_ops[j].name) == 0)
+				break;
+		}
+		if (j == nitems(outline_ops)) {
+			log_debug("%s: unknown outline '%s'", __func__, name);
+			continue;
+		}
+		cs->outline |= outline_ops[j].flag;
+	}
+}
+
+static uint64_t
+config_opts_hash(cfg_opt_t *opts, uint64_t h)
+{
+	cfg_opt_t	*o;
+
+	for (o = opts; o->name != NULL; o++) {
+		h = u_hash(o->name, strlen(o->name) + 1, h);
+		h = u_hash(&o->type, sizeof(o->type), h);
+		/* Lists keep their default unparsed. */
+		if (o->def.parsed != NULL)
+			h = u_hash(o->def.parsed, strlen(o->def.parsed) + 1, h);
+		switch (o->type) {
+		case CFGT_INT:
+			h = u_hash(&o->def.number, sizeof(o->def.number), h);
+			break;
+		case CFGT_BOOL:
+			h = u_hash(&o->def.boolean, sizeof(o->def.boolean), h);
+			break;
+		case CFGT_STR:
+			if (o->def.string != NULL)
+				h = u_hash(o->def.string,
+				    strlen(o->def.string) + 1, h);
+			break;
+		case CFGT_SEC:
+			h = config_opts_hash(o->subopts, h);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return(h);
+}
+
+/*
+ * The defaults compiled in here end up in the cache alongside the user's
+ * settings, so a cache written by a different build mustn't be used.
+ */
+uint64_t
+config_default_hash(void)
+{
+	char		 buf[8192];
+	uint64_t	 h;
+
+	(void)strlcpy(buf, DEFAULT_CONFIG_REST(DEFAULT_BINDINGS), sizeof(buf));
+	h = u_hash(buf, strlen(buf) + 1, 0);
+	(void)strlcpy(buf, DEFAULT_CONFIG_SCR(""), sizeof(buf));
+	h = u_hash(buf, strlen(buf) + 1, h);
+
+	return(config_opts_hash(all_cfg_opts, h));
 }
 
 void
 config_parse(void)
 {
 	cfg_t	*cfg_default, *cfg_default_rest, *cfg;
+	bool	 parse_error = false;
 
 	XGrabServer(X_Dpy);
 
 	TAILQ_INIT(&keybindingq);
 	TAILQ_INIT(&mousebindingq);
-	TAILQ_INIT(&ignoreq);
-	TAILQ_INIT(&autogroupq);
+	TAILQ_INIT(&matchq);
 	TAILQ_INIT(&cmdq);
 	TAILQ_INIT(&ruleq);
 
 	(void)snprintf(known_hosts, sizeof(known_hosts), "%s/%s",
 	    homedir, ".ssh/known_hosts");
 
+	if (conf_path != NULL && config_cache_load() == 0) {
+		log_debug("Loaded '%s' from cache", conf_path);
+		goto apply;
+	}
+
 	if ((cfg_default = cfg_init(all_cfg_opts, CFGF_NONE)) == NULL)
 		log_fatal("Couldn't init  config options");
 
@@ -602,11 +764,15 @@ config_parse(void)
 		log_fatal("Couldn't init config options");
 	if (cfg_parse(cfg, conf_path) == CFG_PARSE_ERROR) {
 		log_debug("Couldn't parse '%s': %s", conf_path, strerror(errno));
+		parse_error = true;
 	}
 
 	if (cfg_size(cfg, "screen") > 0)
 		config_default(cfg, CFG_DEF_USER);
 
+	/* Don't cache a broken file; it should be reported every time. */
+	if (!parse_error)
+		config_cache_save();
 
 apply:
 	config_apply();
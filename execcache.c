@@ -0,0 +1,294 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Copyright (c) 2017 Thomas Adam <thomas@xteddy.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * An index of the executables in $PATH, for the exec menu.
+ *
+ * Each directory is scanned once and kept.  Where inotify is available and
+ * the directory is on a local filesystem, a watch marks it dirty when its
+ * contents change; otherwise the directory's mtime is checked each time
+ * the index is used.  Only dirty directories are scanned again.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <paths.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+#define EXEC_NPATHS	256
+
+struct exec_dir {
+	char		*path;
+	int		 wd;		/* inotify watch, or -1 */
+	int		 dirty;
+	struct timespec	 mtime;
+	char		**names;
+	size_t		 nnames;
+};
+
+static struct exec_dir	 exec_dirs[EXEC_NPATHS];
+static size_t		 exec_ndirs;
+static char		*exec_pathenv;
+static int		 exec_ifd = -1;
+
+static void	 exec_cache_clear(void);
+static void	 exec_cache_setpath(const char *);
+static void	 exec_cache_watch(struct exec_dir *);
+static void	 exec_cache_drain(void);
+static int	 exec_cache_stale(struct exec_dir *);
+static void	 exec_cache_scan(struct exec_dir *, struct menu_src *);
+
+static void
+exec_cache_clear(void)
+{
+	size_t	 i, j;
+
+	for (i = 0; i < exec_ndirs; i++) {
+#if defined(__linux__)
+		if (exec_dirs[i].wd != -1)
+			(void)inotify_rm_watch(exec_ifd, exec_dirs[i].wd);
+#endif
+		for (j = 0; j < exec_dirs[i].nnames; j++)
+			free(exec_dirs[i].names[j]);
+		free(exec_dirs[i].names);
+		free(exec_dirs[i].path);
+	}
+	memset(exec_dirs, 0, sizeof(exec_dirs));
+	exec_ndirs = 0;
+}
+
+static void
+exec_cache_setpath(const char *path)
+{
+	char	*pathcpy, *p, *dir;
+
+	exec_cache_clear();
+	free(exec_pathenv);
+	exec_pathenv = xstrdup(path);
+
+	pathcpy = p = xstrdup(path);
+	while (exec_ndirs < EXEC_NPATHS - 1 &&
+	    (dir = strsep(&p, ":")) != NULL) {
+		if (*dir == '\0')
+			continue;
+		exec_dirs[exec_ndirs].path = xstrdup(dir);
+		exec_dirs[exec_ndirs].wd = -1;
+		exec_dirs[exec_ndirs].dirty = 1;
+		exec_cache_watch(&exec_dirs[exec_ndirs]);
+		exec_ndirs++;
+	}
+	free(pathcpy);
+}
+
+static void
+exec_cache_watch(struct exec_dir *ed)
+{
+#if defined(__linux__)
+	struct statfs	 sfs;
+
+	if (exec_ifd == -1)
+		return;
+
+	/* inotify never hears about changes made by other NFS clients. */
+	if (statfs(ed->path, &sfs) == -1)
+		return;
+	switch (sfs.f_type) {
+	case 0x6969:		/* NFS */
+	case 0x517b:		/* SMB */
+	case 0xff534d42:	/* CIFS */
+	case 0x65735546:	/* FUSE */
+		log_debug("%s: %s is remote; checking mtime instead",
+		    __func__, ed->path);
+		return;
+	}
+
+	ed->wd = inotify_add_watch(exec_ifd, ed->path,
+	    IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+	    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+#endif
+}
+
+/* Mark dirty whichever directories inotify has told us about. */
+static void
+exec_cache_drain(void)
+{
+#if defined(__linux__)
+	char				 buf[4096]
+	    __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event	*ev;
+	ssize_t				 len;
+	char				*p;
+	size_t				 i;
+
+	if (exec_ifd == -1)
+		return;
+
+	while ((len = read(exec_ifd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)p;
+			for (i = 0; i < exec_ndirs; i++) {
+				if (ev->mask & IN_Q_OVERFLOW) {
+					exec_dirs[i].dirty = 1;
+					continue;
+				}
+				if (exec_dirs[i].wd != ev->wd)
+					continue;
+				exec_dirs[i].dirty = 1;
+				/*
+				 * The directory is gone, or moved away with
+				 * the watch; go back to its mtime until the
+				 * scan can watch whatever is there again.
+				 */
+				if (ev->mask & IN_MOVE_SELF)
+					(void)inotify_rm_watch(exec_ifd,
+					    ev->wd);
+				if (ev->mask & (IN_DELETE_SELF |
+				    IN_MOVE_SELF | IN_IGNORED))
+					exec_dirs[i].wd = -1;
+			}
+		}
+	}
+#endif
+}
+
+static int
+exec_cache_stale(struct exec_dir *ed)
+{
+	struct stat	 sb;
+
+	if (ed->dirty)
+		return(1);
+	if (ed->wd != -1)
+		return(0);
+
+	if (stat(ed->path, &sb) == -1)
+		return(ed->nnames > 0);
+
+	return(sb.st_mtim.tv_sec != ed->mtime.tv_sec ||
+	    sb.st_mtim.tv_nsec != ed->mtime.tv_nsec);
+}
+
+static void
+exec_cache_scan(struct exec_dir *ed, struct menu_src *ms)
+{
+	DIR		*dirp;
+	struct dirent	*dp;
+	struct stat	 sb;
+	size_t		 i;
+
+	for (i = 0; i < ed->nnames; i++)
+		free(ed->names[i]);
+	free(ed->names);
+	ed->names = NULL;
+	ed->nnames = 0;
+	ed->dirty = 0;
+
+	/* A directory that went away may be back, and can be watched. */
+	if (ed->wd == -1)
+		exec_cache_watch(ed);
+
+	/* Take the mtime first, so a change during the scan isn't lost. */
+	if (stat(ed->path, &sb) == -1)
+		return;
+	ed->mtime = sb.st_mtim;
+
+	if ((dirp = opendir(ed->path)) == NULL)
+		return;
+
+	while ((dp = readdir(dirp)) != NULL) {
+		/* Half a list is no use; scan it all again next time. */
+		if (menu_src_cancelled(ms)) {
+			ed->dirty = 1;
+			break;
+		}
+		/* skip everything but regular files and symlinks */
+		if (dp->d_type != DT_REG && dp->d_type != DT_LNK) {
+			/* use an additional stat-based check in case d_type
+			 * isn't supported */
+			if (fstatat(dirfd(dirp), dp->d_name, &sb,
+			    AT_SYMLINK_NOFOLLOW) < 0)
+				continue;
+			if (!S_ISREG(sb.st_mode) && !S_ISLNK(sb.st_mode))
+				continue;
+		}
+		if (faccessat(dirfd(dirp), dp->d_name, X_OK, 0) != 0)
+			continue;
+
+		ed->names = xreallocarray(ed->names, ed->nnames + 1,
+		    sizeof(*ed->names));
+		ed->names[ed->nnames++] = xstrdup(dp->d_name);
+	}
+	(void)closedir(dirp);
+
+	log_debug("%s: %s: %zu executables", __func__, ed->path, ed->nnames);
+}
+
+void
+exec_cache_init(void)
+{
+#if defined(__linux__)
+	if (exec_ifd != -1)
+		return;
+	if ((exec_ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+		log_debug("%s: inotify_init1: %s", __func__, strerror(errno));
+#endif
+}
+
+/*
+ * Hand every executable in $PATH to a menu source, rescanning only what
+ * changed.  This runs on the menu's producer thread.
+ */
+void
+exec_cache_get(struct menu_src *ms)
+{
+	const char	*path;
+	size_t		 i, j;
+
+	if ((path = getenv("PATH")) == NULL)
+		path = _PATH_DEFPATH;
+	if (exec_pathenv == NULL || strcmp(exec_pathenv, path) != 0)
+		exec_cache_setpath(path);
+
+	exec_cache_drain();
+
+	for (i = 0; i < exec_ndirs; i++) {
+		if (menu_src_cancelled(ms))
+			return;
+		if (exec_cache_stale(&exec_dirs[i]))
+			exec_cache_scan(&exec_dirs[i], ms);
+		for (j = 0; j < exec_dirs[i].nnames; j++) {
+			if (menu_src_add(ms, NULL, "%s",
+			    exec_dirs[i].names[j]) == -1)
+				return;
+		}
+	}
+}
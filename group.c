@@ -352,10 +352,11 @@ void
 group_autogroup(struct client_ctx *cc)
 {
 	struct screen_ctx	*sc = cc->sc;
-	struct autogroupwin	*aw;
+	struct match		**matches;
 	struct group_ctx	*gc;
-	int			 num = -2, both_match = 0;
+	int			 num = -2, best = -1;
 	long			*grpnum;
+	size_t			 i, n;
 
 	if (cc->ch.res_class == NULL || cc->ch.res_name == NULL) {
 		group_assign(NULL, cc);
@@ -369,15 +370,14 @@ group_autogroup(struct client_ctx *cc)
 			num = CALMWM_NGROUPS - 1;
 		XFree(grpnum);
 	} else {
-		TAILQ_FOREACH(aw, &autogroupq, entry) {
-			if (strcmp(aw->class, cc->ch.res_class) == 0) {
-				if ((aw->name != NULL) &&
-				    (strcmp(aw->name, cc->ch.res_name) == 0)) {
-					num = aw->num;
-					both_match = 1;
-				} else if (aw->name == NULL && !both_match)
-					num = aw->num;
-			}
+		/* The more specific last match wins. */
+		matches = match_client(cc, &n);
+		for (i = 0; i < n; i++) {
+			if (matches[i]->group == -1 ||
+			    matches[i]->nfields < best)
+				continue;
+			num = matches[i]->group;
+			best = matches[i]->nfields;
 		}
 	}
 
@@ -0,0 +1,220 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Copyright (c) 2017 Thomas Adam <thomas@xteddy.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * What gets picked from the menus, and how recently, so that the match
+ * functions can rank the things actually used ahead of the rest.
+ *
+ * The history is a fixed-size, open-addressed table of hashed keys mapped
+ * straight from a file in the cache directory, so there is nothing to
+ * parse at startup and nothing to save on exit.  Each key has a count
+ * which halves every HISTORY_HALFLIFE hours; when a key's neighbourhood
+ * is full, the one with the lowest decayed count makes way.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+#define HISTORY_MAGIC		0x68776d63	/* "cmwh" */
+#define HISTORY_VERSION		1
+#define HISTORY_NSLOTS		4096		/* a power of two */
+#define HISTORY_NPROBE		8
+#define HISTORY_HALFLIFE	(7 * 24)	/* hours */
+
+struct history_slot {
+	uint64_t	 key;		/* 0 if unused */
+	float		 count;
+	uint32_t	 stamp;		/* hours since the epoch */
+};
+
+struct history_file {
+	uint32_t		 magic;
+	uint32_t		 version;
+	uint32_t		 nslots;
+	uint32_t		 pad;
+	struct history_slot	 slot[HISTORY_NSLOTS];
+};
+
+static struct history_file	*history;
+
+static uint32_t			 history_now(void);
+static float			 history_decay(const struct history_slot *,
+				     uint32_t);
+static struct history_slot	*history_lookup(uint64_t, int);
+
+static uint32_t
+history_now(void)
+{
+	return((uint32_t)(time(NULL) / 3600));
+}
+
+/* Halve per half-life, and interpolate in between; close enough. */
+static float
+history_decay(const struct history_slot *hs, uint32_t now)
+{
+	uint32_t	 age, n;
+	float		 count;
+
+	age = (now > hs->stamp) ? now - hs->stamp : 0;
+	if ((n = age / HISTORY_HALFLIFE) >= 32)
+		return(0.0);
+
+	count = hs->count / (float)(1U << n);
+	age %= HISTORY_HALFLIFE;
+
+	return(count * (1.0f - 0.5f * age / HISTORY_HALFLIFE));
+}
+
+static struct history_slot *
+history_lookup(uint64_t key, int create)
+{
+	struct history_slot	*hs, *empty = NULL, *victim = NULL;
+	uint32_t		 now = history_now();
+	float			 low = 0.0, count;
+	unsigned int		 i;
+
+	for (i = 0; i < HISTORY_NPROBE; i++) {
+		hs = &history->slot[(key + i) & (HISTORY_NSLOTS - 1)];
+		if (hs->key == key)
+			return(hs);
+		if (!create)
+			continue;
+		if (hs->key == 0) {
+			if (empty == NULL)
+				empty = hs;
+			continue;
+		}
+		count = history_decay(hs, now);
+		if (victim == NULL || count < low) {
+			victim = hs;
+			low = count;
+		}
+	}
+	if (!create)
+		return(NULL);
+
+	hs = (empty != NULL) ? empty : victim;
+	hs->key = key;
+	hs->count = 0.0;
+	hs->stamp = now;
+
+	return(hs);
+}
+
+void
+history_init(void)
+{
+	struct history_file	*hf;
+	struct stat		 sb;
+	char			*path;
+	int			 fd;
+
+	if (history != NULL)
+		return;
+	if ((path = u_cache_path("cwm-new-history")) == NULL)
+		return;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1) {
+		log_debug("%s: open %s: %s", __func__, path, strerror(errno));
+		free(path);
+		return;
+	}
+	if (fstat(fd, &sb) == -1 ||
+	    (sb.st_size != sizeof(*hf) && ftruncate(fd, sizeof(*hf)) == -1)) {
+		log_debug("%s: %s: %s", __func__, path, strerror(errno));
+		goto out;
+	}
+
+	hf = mmap(NULL, sizeof(*hf), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hf == MAP_FAILED) {
+		log_debug("%s: mmap %s: %s", __func__, path, strerror(errno));
+		goto out;
+	}
+	if (hf->magic != HISTORY_MAGIC || hf->version != HISTORY_VERSION ||
+	    hf->nslots != HISTORY_NSLOTS) {
+		log_debug("%s: %s: starting afresh", __func__, path);
+		memset(hf, 0, sizeof(*hf));
+		hf->magic = HISTORY_MAGIC;
+		hf->version = HISTORY_VERSION;
+		hf->nslots = HISTORY_NSLOTS;
+	}
+	history = hf;
+out:
+	(void)close(fd);
+	free(path);
+}
+
+/*
+ * The key for a menu entry's text, or for a window's class and instance
+ * when b is given; the two never collide with one another.
+ */
+uint64_t
+history_key(const char *a, const char *b)
+{
+	uint64_t	 h;
+
+	if (a == NULL)
+		a = "";
+	if (b == NULL)
+		h = u_hash(a, strlen(a), 0);
+	else {
+		h = u_hash(a, strlen(a) + 1, 0);
+		h = u_hash(b, strlen(b), h);
+	}
+
+	return((h == 0) ? 1 : h);
+}
+
+void
+history_add(uint64_t key)
+{
+	struct history_slot	*hs;
+	uint32_t		 now;
+
+	if (history == NULL)
+		return;
+
+	now = history_now();
+	hs = history_lookup(key, 1);
+	hs->count = history_decay(hs, now) + 1.0f;
+	hs->stamp = now;
+}
+
+/* How much, and how lately, key has been used; 0 if never. */
+float
+history_score(uint64_t key)
+{
+	struct history_slot	*hs;
+
+	if (history == NULL || (hs = history_lookup(key, 0)) == NULL)
+		return(0.0);
+
+	return(history_decay(hs, history_now()));
+}
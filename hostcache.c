@@ -0,0 +1,203 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Copyright (c) 2017 Thomas Adam <thomas@xteddy.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The hosts in known_hosts, for the ssh menu.
+ *
+ * The file is mapped and read through once, and the hosts kept sorted and
+ * without duplicates.  It is only read again when its inode, size or
+ * mtime change.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+#define HASH_MARKER	"|1|"
+
+struct host_tok {
+	const char	*p;
+	size_t		 len;
+};
+
+static char		**host_names;
+static size_t		  host_nnames;
+static char		 *host_buf;
+static struct stat	  host_sb;
+
+static int	 host_cache_stale(const struct stat *);
+static void	 host_cache_read(struct menu_src *);
+static int	 host_tok_cmp(const void *, const void *);
+
+static int
+host_cache_stale(const struct stat *sb)
+{
+	return(host_names == NULL ||
+	    sb->st_dev != host_sb.st_dev || sb->st_ino != host_sb.st_ino ||
+	    sb->st_size != host_sb.st_size ||
+	    sb->st_mtim.tv_sec != host_sb.st_mtim.tv_sec ||
+	    sb->st_mtim.tv_nsec != host_sb.st_mtim.tv_nsec);
+}
+
+static int
+host_tok_cmp(const void *a, const void *b)
+{
+	const struct host_tok	*ta = a, *tb = b;
+	int			 r;
+
+	if ((r = memcmp(ta->p, tb->p, MIN(ta->len, tb->len))) != 0)
+		return(r);
+	return(ta->len < tb->len ? -1 : ta->len > tb->len);
+}
+
+static void
+host_cache_read(struct menu_src *ms)
+{
+	struct host_tok	*v = NULL;
+	struct stat	 sb;
+	const char	*base, *p, *end, *eol, *q;
+	char		*dst;
+	size_t		 i, n = 0, nalloc = 0, total = 0;
+	int		 fd;
+
+	free(host_names);
+	free(host_buf);
+	host_names = NULL;
+	host_buf = NULL;
+	host_nnames = 0;
+
+	if ((fd = open(known_hosts, O_RDONLY | O_CLOEXEC)) == -1) {
+		log_debug("%s: %s: %s", __func__, known_hosts, strerror(errno));
+		return;
+	}
+	if (fstat(fd, &sb) == -1) {
+		(void)close(fd);
+		return;
+	}
+	host_sb = sb;
+
+	/* An empty list, but a valid one, so an empty file isn't re-read. */
+	host_names = xcalloc(1, sizeof(*host_names));
+	if (sb.st_size == 0) {
+		(void)close(fd);
+		return;
+	}
+
+	base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	(void)close(fd);
+	if (base == MAP_FAILED) {
+		log_debug("%s: mmap: %s", __func__, strerror(errno));
+		free(host_names);
+		host_names = NULL;
+		return;
+	}
+	(void)madvise((void *)base, sb.st_size, MADV_SEQUENTIAL);
+
+	end = base + sb.st_size;
+	for (p = base; p < end; p = eol + 1) {
+		/* Leave the cache empty, so it's read again next time. */
+		if (menu_src_cancelled(ms)) {
+			(void)munmap((void *)base, sb.st_size);
+			free(v);
+			free(host_names);
+			host_names = NULL;
+			return;
+		}
+		if ((eol = memchr(p, '\n', end - p)) == NULL)
+			eol = end;
+
+		/* skip hashed hosts, comments and blank lines */
+		if (eol - p >= (ptrdiff_t)strlen(HASH_MARKER) &&
+		    memcmp(p, HASH_MARKER, strlen(HASH_MARKER)) == 0)
+			continue;
+		if (p == eol || *p == '#')
+			continue;
+
+		for (q = p; q < eol && *q != ',' && *q != ' '; q++)
+			;
+		/* ignore badness */
+		if (q - p > _POSIX_HOST_NAME_MAX)
+			continue;
+
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 256;
+			v = xreallocarray(v, nalloc, sizeof(*v));
+		}
+		v[n].p = p;
+		v[n].len = q - p;
+		n++;
+	}
+
+	if (n > 0)
+		qsort(v, n, sizeof(*v), host_tok_cmp);
+	for (i = 0; i < n; i++) {
+		if (i > 0 && host_tok_cmp(&v[i], &v[host_nnames - 1]) == 0)
+			continue;
+		v[host_nnames++] = v[i];
+		total += v[i].len + 1;
+	}
+
+	/* One block for all the names, and the list pointing into it. */
+	host_names = xreallocarray(host_names, host_nnames + 1,
+	    sizeof(*host_names));
+	host_buf = dst = xmalloc(total + 1);
+	for (i = 0; i < host_nnames; i++) {
+		host_names[i] = dst;
+		(void)memcpy(dst, v[i].p, v[i].len);
+		dst[v[i].len] = '\0';
+		dst += v[i].len + 1;
+	}
+
+	(void)munmap((void *)base, sb.st_size);
+	free(v);
+
+	log_debug("%s: %s: %zu lines, %zu hosts", __func__, known_hosts, n,
+	    host_nnames);
+}
+
+/*
+ * Hand every host in known_hosts to a menu source, reading the file again
+ * only if it has changed.  This runs on the menu's producer thread.
+ */
+void
+host_cache_get(struct menu_src *ms)
+{
+	struct stat	 sb;
+	size_t		 i;
+
+	if (stat(known_hosts, &sb) == -1)
+		return;
+	if (host_cache_stale(&sb))
+		host_cache_read(ms);
+
+	for (i = 0; i < host_nnames; i++) {
+		if (menu_src_add(ms, NULL, "%s", host_names[i]) == -1)
+			return;
+	}
+}
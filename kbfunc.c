@@ -20,11 +20,9 @@
 
 #include <sys/types.h>
 
-#include <dirent.h>
 #include <err.h>
 #include <errno.h>
 #include <limits.h>
-#include <paths.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,7 +31,8 @@
 
 #include "calmwm.h"
 
-#define HASH_MARKER	"|1|"
+static void	kbfunc_exec_src(struct menu_src *, void *);
+static void	kbfunc_ssh_src(struct menu_src *, void *);
 
 void
 kbfunc_client_lower(struct client_ctx *cc, union arg *arg)
@@ -64,7 +63,7 @@ kbfunc_client_moveresize(struct client_ctx *cc, union arg *arg)
 
 	mx = my = 0;
 
-	flags = arg->i;
+	flags = arg->p.flags;
 	amt = CONF_MAMOUNT;
 
 	if (flags & CWM_BIGMOVE) {
@@ -72,6 +71,13 @@ kbfunc_client_moveresize(struct client_ctx *cc, union arg *arg)
 		amt = amt * 10;
 	}
 
+	/* An explicit amount, as in "moveup 20", wins. */
+	if (arg->p.n > 0)
+		amt = arg->p.n;
+
+	/* Held down, the key may have got ahead of us; catch up at once. */
+	amt *= 1 + xev_key_repeats();
+
 	switch (flags & MOVEMASK) {
 	case CWM_UP:
 		my -= amt;
@@ -147,21 +153,27 @@ kbfunc_client_search(struct client_ctx *cc, union arg *arg)
 	struct client_ctx	*old_cc;
 	struct menu		*mi;
 	struct menu_q		 menuq;
+	Window			 old_win;
 
+	/* It may go while the menu is up; find it again after. */
 	old_cc = client_current();
+	old_win = (old_cc != NULL) ? old_cc->win : None;
 
-	TAILQ_INIT(&menuq);
+	menuq_init(&menuq);
 	TAILQ_FOREACH(all_sc, &Screenq, entry) {
 		TAILQ_FOREACH(cc, &all_sc->clientq, entry)
 			menuq_add(&menuq, cc, NULL);
 	}
 
-	if ((mi = menu_filter(sc, &menuq, "window", NULL, 0,
-	    search_match_client, search_print_client)) != NULL) {
+	if ((mi = menu_filter(sc, &menuq, "window", NULL, CWM_MENU_WINDOW,
+	    (sc->config_screen->fuzzy & CWM_FUZZY_WINDOW) ?
+	    search_match_fuzzy_client : search_match_client,
+	    search_print_client)) != NULL) {
 		cc = (struct client_ctx *)mi->ctx;
+		history_add(history_key(cc->ch.res_class, cc->ch.res_name));
 		if (cc->flags & CLIENT_HIDDEN)
 			client_unhide(cc);
-		if (old_cc)
+		if (old_win != None && (old_cc = client_find(old_win)) != NULL)
 			client_ptrsave(old_cc);
 		client_ptrwarp(cc);
 
@@ -183,13 +195,16 @@ kbfunc_menu_cmd(struct client_ctx *cc, union arg *arg)
 	struct menu		*mi;
 	struct menu_q		 menuq;
 
-	TAILQ_INIT(&menuq);
+	menuq_init(&menuq);
 	TAILQ_FOREACH(cmd, &cmdq, entry)
 		menuq_add(&menuq, cmd, "%s", cmd->name);
 
 	if ((mi = menu_filter(sc, &menuq, "application", NULL, 0,
-	    search_match_text, NULL)) != NULL)
+	    (sc->config_screen->fuzzy & CWM_FUZZY_APPLICATION) ?
+	    search_match_fuzzy : search_match_text, NULL)) != NULL) {
+		history_add(history_key(mi->text, NULL));
 		u_spawn(((struct cmd *)mi->ctx)->path);
+	}
 
 	menuq_clear(&menuq);
 }
@@ -202,13 +217,15 @@ kbfunc_menu_group(struct client_ctx *cc, union arg *arg)
 	struct menu		*mi;
 	struct menu_q		 menuq;
 
-	TAILQ_INIT(&menuq);
+	menuq_init(&menuq);
 	TAILQ_FOREACH(gc, &sc->groupq, entry) {
 		menuq_add(&menuq, gc, "%d %s", gc->num, gc->name);
 	}
 
 	if ((mi = menu_filter(sc, &menuq, "group", NULL, CWM_MENU_LIST,
-	    search_match_text, search_print_group)) != NULL) {
+	    (sc->config_screen->fuzzy & CWM_FUZZY_GROUP) ?
+	    search_match_fuzzy : search_match_text,
+	    search_print_group)) != NULL) {
 		gc = (struct group_ctx *)mi->ctx;
 		(group_holds_only_hidden(gc)) ?
 		    group_show(gc) : group_hide(gc);
@@ -263,74 +280,45 @@ kbfunc_lock(struct client_ctx *cc, union arg *arg)
 	}
 }
 
+static void
+kbfunc_exec_src(struct menu_src *ms, void *arg)
+{
+	exec_cache_get(ms);
+}
+
 void
 kbfunc_exec(struct client_ctx *cc, union arg *arg)
 {
-#define NPATHS 256
 	struct screen_ctx	*sc = cc->sc;
-	char			**ap, *paths[NPATHS], *path, *pathcpy;
-	char			 tpath[PATH_MAX];
 	const char		*label;
-	DIR			*dirp;
-	struct dirent		*dp;
 	struct menu		*mi;
 	struct menu_q		 menuq;
-	int			 l, i, cmd = arg->i;
-	struct stat		 sb;
+	int			 cmd = arg->i, fuzzy;
 
 	switch (cmd) {
 	case CWM_EXEC_PROGRAM:
 		label = "exec";
+		fuzzy = CWM_FUZZY_EXEC;
 		break;
 	case CWM_EXEC_WM:
 		label = "wm";
+		fuzzy = CWM_FUZZY_WM;
 		break;
 	default:
 		log_fatal("%s: invalid cmd %d", __func__, cmd);
 	}
 
-	TAILQ_INIT(&menuq);
-
-	if ((path = getenv("PATH")) == NULL)
-		path = _PATH_DEFPATH;
-	pathcpy = path = xstrdup(path);
-
-	for (ap = paths; ap < &paths[NPATHS - 1] &&
-	    (*ap = strsep(&pathcpy, ":")) != NULL;) {
-		if (**ap != '\0')
-			ap++;
-	}
-	*ap = NULL;
-	for (i = 0; i < NPATHS && paths[i] != NULL; i++) {
-		if ((dirp = opendir(paths[i])) == NULL)
-			continue;
-
-		while ((dp = readdir(dirp)) != NULL) {
-			(void)memset(tpath, '\0', sizeof(tpath));
-			l = snprintf(tpath, sizeof(tpath), "%s/%s", paths[i],
-			    dp->d_name);
-			if (l == -1 || l >= sizeof(tpath))
-				continue;
-			/* skip everything but regular files and symlinks */
-			if (dp->d_type != DT_REG && dp->d_type != DT_LNK) {
-				/* use an additional stat-based check in case d_type isn't supported */
-				if (lstat(tpath, &sb) < 0)
-					continue;
-				if (!S_ISREG(sb.st_mode) && !S_ISLNK(sb.st_mode))
-					continue;
-			}
-			if (access(tpath, X_OK) == 0)
-				menuq_add(&menuq, NULL, "%s", dp->d_name);
-		}
-		(void)closedir(dirp);
-	}
-	free(path);
+	menuq_init(&menuq);
 
-	if ((mi = menu_filter(sc, &menuq, label, NULL,
+	if ((mi = menu_filter_src(sc, &menuq, label, NULL,
 	    CWM_MENU_DUMMY | CWM_MENU_FILE,
-	    search_match_exec_path, NULL)) != NULL) {
+	    (sc->config_screen->fuzzy & fuzzy) ?
+	    search_match_fuzzy_exec_path : search_match_exec_path, NULL,
+	    kbfunc_exec_src, NULL)) != NULL) {
 		if (mi->text[0] == '\0')
 			goto out;
+		if (!mi->dummy)
+			history_add(history_key(mi->text, NULL));
 		switch (cmd) {
 		case CWM_EXEC_PROGRAM:
 			u_spawn(mi->text);
@@ -350,6 +338,12 @@ out:
 	menuq_clear(&menuq);
 }
 
+static void
+kbfunc_ssh_src(struct menu_src *ms, void *arg)
+{
+	host_cache_get(ms);
+}
+
 void
 kbfunc_ssh(struct client_ctx *cc, union arg *arg)
 {
@@ -357,14 +351,10 @@ kbfunc_ssh(struct client_ctx *cc, union arg *arg)
 	struct cmd		*cmd;
 	struct menu		*mi;
 	struct menu_q		 menuq;
-	FILE			*fp;
-	char			*buf, *lbuf, *p;
-	char			 hostbuf[_POSIX_HOST_NAME_MAX+1];
 	char			 path[PATH_MAX];
 	int			 l;
-	size_t			 len;
 
-	if ((fp = fopen(known_hosts, "r")) == NULL) {
+	if (access(known_hosts, R_OK) == -1) {
 		log_debug("%s: %s", __func__, known_hosts);
 		return;
 	}
@@ -374,38 +364,16 @@ kbfunc_ssh(struct client_ctx *cc, union arg *arg)
 			break;
 	}
 
-	TAILQ_INIT(&menuq);
-
-	lbuf = NULL;
-	while ((buf = fgetln(fp, &len))) {
-		if (buf[len - 1] == '\n')
-			buf[len - 1] = '\0';
-		else {
-			/* EOF without EOL, copy and add the NUL */
-			lbuf = xmalloc(len + 1);
-			(void)memcpy(lbuf, buf, len);
-			lbuf[len] = '\0';
-			buf = lbuf;
-		}
-		/* skip hashed hosts */
-		if (strncmp(buf, HASH_MARKER, strlen(HASH_MARKER)) == 0)
-			continue;
-		for (p = buf; *p != ',' && *p != ' ' && p != buf + len; p++) {
-			/* do nothing */
-		}
-		/* ignore badness */
-		if (p - buf + 1 > sizeof(hostbuf))
-			continue;
-		(void)strlcpy(hostbuf, buf, p - buf + 1);
-		menuq_add(&menuq, NULL, hostbuf);
-	}
-	free(lbuf);
-	(void)fclose(fp);
+	menuq_init(&menuq);
 
-	if ((mi = menu_filter(sc, &menuq, "ssh", NULL, CWM_MENU_DUMMY,
-	    search_match_exec, NULL)) != NULL) {
+	if ((mi = menu_filter_src(sc, &menuq, "ssh", NULL, CWM_MENU_DUMMY,
+	    (sc->config_screen->fuzzy & CWM_FUZZY_SSH) ?
+	    search_match_fuzzy : search_match_exec, NULL,
+	    kbfunc_ssh_src, NULL)) != NULL) {
 		if (mi->text[0] == '\0')
 			goto out;
+		if (!mi->dummy)
+			history_add(history_key(mi->text, NULL));
 		l = snprintf(path, sizeof(path), "%s -T '[ssh] %s' -e ssh %s",
 		    cmd->path, mi->text, mi->text);
 		if (l == -1 || l >= sizeof(path))
@@ -423,16 +391,22 @@ kbfunc_client_label(struct client_ctx *cc, union arg *arg)
 {
 	struct menu	*mi;
 	struct menu_q	 menuq;
+	Window		 win = cc->win;
 
-	TAILQ_INIT(&menuq);
+	menuq_init(&menuq);
 
-	/* dummy is set, so this will always return */
-	mi = menu_filter(cc->sc, &menuq, "label", cc->label, CWM_MENU_DUMMY,
-	    search_match_text, NULL);
+	/* dummy is set, so this returns unless a menu is already up */
+	if ((mi = menu_filter(cc->sc, &menuq, "label", cc->label,
+	    CWM_MENU_DUMMY, search_match_text, NULL)) == NULL)
+		return;
 
-	if (!mi->abort) {
+	/* The window may have gone while the menu was up. */
+	if ((cc = client_find(win)) != NULL && !mi->abort) {
 		free(cc->label);
+		free(cc->label_fold);
 		cc->label = xstrdup(mi->text);
+		cc->label_fold = u_fold(cc->label);
+		trigram_update(cc);
 	}
 	free(mi);
 }
@@ -0,0 +1,419 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Copyright (c) 2017 Thomas Adam <thomas@xteddy.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Client matching.
+ *
+ * Each "client" block in the config compiles to one struct match, holding
+ * a pattern for any of the class, instance, title and window type.  A
+ * pattern is an exact string, a glob if it contains any of "*?[", or an
+ * extended regular expression if it is written as /.../.
+ *
+ * Matches whose class is an exact string are indexed by that class, so a
+ * client only ever gets tested against those for its own class plus the
+ * ones with a wildcard class.  The result for a client is kept until one of
+ * the properties that was matched on changes.
+ */
+
+#include <sys/types.h>
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calmwm.h"
+
+#define MATCH_NBUCKETS	64
+
+struct match_bucket {
+	struct match_bucket	*next;
+	char			*class;
+	struct match		**list;
+	size_t			 n;
+};
+
+static struct match_bucket	*match_buckets[MATCH_NBUCKETS];
+static struct match		**match_wild;
+static size_t			 match_nwild;
+static int			 match_nextid;
+static int			 match_used;	/* fields any match looks at */
+static unsigned int		 match_gen = 1;
+
+static int		 match_pat_compile(struct match_pat *, const char *);
+static int		 match_pat_test(struct match_pat *, const char *);
+static void		 match_pat_free(struct match_pat *);
+static void		 match_index(struct match *);
+static const char	*match_client_field(struct client_ctx *, int);
+static int		 match_test(struct match *, struct client_ctx *);
+static void		 match_resolve(struct client_ctx *);
+
+static int
+match_pat_compile(struct match_pat *mp, const char *str)
+{
+	size_t	 len;
+	char	*re;
+	int	 error;
+	char	 errbuf[256];
+
+	if (str == NULL || *str == '\0') {
+		mp->kind = MATCH_ANY;
+		return(0);
+	}
+
+	len = strlen(str);
+	mp->str = xstrdup(str);
+
+	if (len > 2 && str[0] == '/' && str[len - 1] == '/') {
+		re = xstrdup(str + 1);
+		re[len - 2] = '\0';
+		error = regcomp(&mp->re, re, REG_EXTENDED | REG_NOSUB);
+		free(re);
+		if (error != 0) {
+			regerror(error, &mp->re, errbuf, sizeof(errbuf));
+			log_debug("%s: bad expression '%s': %s", __func__,
+			    str, errbuf);
+			free(mp->str);
+			mp->str = NULL;
+			return(-1);
+		}
+		mp->kind = MATCH_REGEX;
+	} else if (strpbrk(str, "*?[") != NULL)
+		mp->kind = MATCH_GLOB;
+	else
+		mp->kind = MATCH_EXACT;
+
+	return(0);
+}
+
+static int
+match_pat_test(struct match_pat *mp, const char *s)
+{
+	if (mp->kind == MATCH_ANY)
+		return(1);
+	if (s == NULL)
+		return(0);
+
+	switch (mp->kind) {
+	case MATCH_EXACT:
+		return(strcmp(mp->str, s) == 0);
+	case MATCH_GLOB:
+		return(fnmatch(mp->str, s, 0) == 0);
+	case MATCH_REGEX:
+		return(regexec(&mp->re, s, 0, NULL, 0) == 0);
+	}
+
+	return(0);
+}
+
+static void
+match_pat_free(struct match_pat *mp)
+{
+	if (mp->kind == MATCH_REGEX)
+		regfree(&mp->re);
+	free(mp->str);
+	mp->str = NULL;
+	mp->kind = MATCH_ANY;
+}
+
+static void
+match_index(struct match *m)
+{
+	struct match_bucket	*mb;
+	const char		*class;
+	unsigned int		 h;
+
+	if (m->pat[MATCH_CLASS].kind != MATCH_EXACT) {
+		match_wild = xreallocarray(match_wild, match_nwild + 1,
+		    sizeof(*match_wild));
+		match_wild[match_nwild++] = m;
+		return;
+	}
+
+	class = m->pat[MATCH_CLASS].str;
+	h = u_hash(class, strlen(class), 0) % MATCH_NBUCKETS;
+	for (mb = match_buckets[h]; mb != NULL; mb = mb->next) {
+		if (strcmp(mb->class, class) == 0)
+			break;
+	}
+	if (mb == NULL) {
+		mb = xcalloc(1, sizeof(*mb));
+		mb->class = xstrdup(class);
+		mb->next = match_buckets[h];
+		match_buckets[h] = mb;
+	}
+	mb->list = xreallocarray(mb->list, mb->n + 1, sizeof(*mb->list));
+	mb->list[mb->n++] = m;
+}
+
+/*
+ * Compile a match.  Any pattern may be NULL, meaning "anything".  Returns
+ * NULL if a pattern doesn't compile.
+ */
+struct match *
+match_add(const char *class, const char *instance, const char *title,
+    const char *type)
+{
+	struct match	*m;
+	const char	*strs[MATCH_NFIELDS];
+	int		 i;
+
+	strs[MATCH_CLASS] = class;
+	strs[MATCH_INSTANCE] = instance;
+	strs[MATCH_TITLE] = title;
+	strs[MATCH_TYPE] = type;
+
+	m = xcalloc(1, sizeof(*m));
+	for (i = 0; i < MATCH_NFIELDS; i++) {
+		if (match_pat_compile(&m->pat[i], strs[i]) == -1) {
+			while (--i >= 0)
+				match_pat_free(&m->pat[i]);
+			free(m);
+			return(NULL);
+		}
+		if (m->pat[i].kind != MATCH_ANY) {
+			m->nfields++;
+			match_used |= (1 << i);
+		}
+	}
+	m->id = match_nextid++;
+	m->group = -1;
+	xasprintf(&m->desc, "%s%s%s", instance ? instance : "",
+	    instance ? "," : "", class ? class : "*");
+
+	TAILQ_INSERT_TAIL(&matchq, m, entry);
+	match_index(m);
+	match_gen++;
+
+	log_debug("%s: '%s' (title: %s, type: %s)", __func__, m->desc,
+	    title ? title : "*", type ? type : "*");
+
+	return(m);
+}
+
+void
+match_clear(void)
+{
+	struct match		*m, *m_tmp;
+	struct match_bucket	*mb, *mb_tmp;
+	int			 i;
+
+	TAILQ_FOREACH_SAFE(m, &matchq, entry, m_tmp) {
+		TAILQ_REMOVE(&matchq, m, entry);
+		for (i = 0; i < MATCH_NFIELDS; i++)
+			match_pat_free(&m->pat[i]);
+		free(m->desc);
+		free(m);
+	}
+
+	for (i = 0; i < MATCH_NBUCKETS; i++) {
+		for (mb = match_buckets[i]; mb != NULL; mb = mb_tmp) {
+			mb_tmp = mb->next;
+			free(mb->class);
+			free(mb->list);
+			free(mb);
+		}
+		match_buckets[i] = NULL;
+	}
+	free(match_wild);
+	match_wild = NULL;
+	match_nwild = 0;
+	match_nextid = 0;
+	match_used = 0;
+	match_gen++;
+}
+
+static const char *
+match_client_field(struct client_ctx *cc, int field)
+{
+	char	*name;
+	Atom	*type;
+
+	switch (field) {
+	case MATCH_CLASS:
+		return(cc->ch.res_class);
+	case MATCH_INSTANCE:
+		return(cc->ch.res_name);
+	case MATCH_TITLE:
+		return(cc->name);
+	case MATCH_TYPE:
+		/* An empty string means the window has no type. */
+		if (cc->wintype != NULL)
+			return(*cc->wintype != '\0' ? cc->wintype : NULL);
+
+		/* Only the first, most preferred, type is considered. */
+		if (xu_getprop(cc->win, ewmh[_NET_WM_WINDOW_TYPE], XA_ATOM,
+		    1L, (unsigned char **)&type) > 0) {
+			if ((name = XGetAtomName(X_Dpy, *type)) != NULL) {
+				if (strncmp(name, "_NET_WM_WINDOW_TYPE_",
+				    20) == 0)
+					cc->wintype = xstrdup(name + 20);
+				else
+					cc->wintype = xstrdup(name);
+				XFree(name);
+			}
+			XFree(type);
+		}
+		if (cc->wintype == NULL) {
+			cc->wintype = xstrdup("");
+			return(NULL);
+		}
+
+		/* So that "dialog" matches _NET_WM_WINDOW_TYPE_DIALOG. */
+		for (name = cc->wintype; *name; name++)
+			*name = tolower((unsigned char)*name);
+
+		return(cc->wintype);
+	}
+
+	return(NULL);
+}
+
+static int
+match_test(struct match *m, struct client_ctx *cc)
+{
+	int	 i;
+
+	for (i = 0; i < MATCH_NFIELDS; i++) {
+		if (m->pat[i].kind == MATCH_ANY)
+			continue;
+		if (!match_pat_test(&m->pat[i], match_client_field(cc, i)))
+			return(0);
+	}
+
+	return(1);
+}
+
+static void
+match_resolve(struct client_ctx *cc)
+{
+	struct match_bucket	*mb = NULL;
+	struct match		*m;
+	const char		*class = cc->ch.res_class;
+	size_t			 i = 0, j = 0;
+
+	free(cc->matches);
+	cc->matches = NULL;
+	cc->nmatches = 0;
+	cc->match_gen = match_gen;
+
+	if (class != NULL) {
+		mb = match_buckets[u_hash(class, strlen(class), 0) %
+		    MATCH_NBUCKETS];
+		for (; mb != NULL; mb = mb->next) {
+			if (strcmp(mb->class, class) == 0)
+				break;
+		}
+	}
+
+	/* Merge the class bucket with the wildcards, keeping config order. */
+	while ((mb != NULL && i < mb->n) || j < match_nwild) {
+		if (mb != NULL && i < mb->n &&
+		    (j == match_nwild || mb->list[i]->id < match_wild[j]->id))
+			m = mb->list[i++];
+		else
+			m = match_wild[j++];
+
+		if (!match_test(m, cc))
+			continue;
+
+		cc->matches = xreallocarray(cc->matches, cc->nmatches + 1,
+		    sizeof(*cc->matches));
+		cc->matches[cc->nmatches++] = m;
+	}
+}
+
+/* The matches which apply to a client, in config order. */
+struct match **
+match_client(struct client_ctx *cc, size_t *n)
+{
+	if (cc->match_gen != match_gen)
+		match_resolve(cc);
+
+	*n = cc->nmatches;
+	return(cc->matches);
+}
+
+int
+match_client_has(struct client_ctx *cc, struct match *m)
+{
+	struct match	**list;
+	size_t		 n, lo = 0, hi;
+
+	list = match_client(cc, &n);
+
+	/* The list is ordered by id. */
+	hi = n;
+	while (lo < hi) {
+		n = lo + (hi - lo) / 2;
+		if (list[n]->id == m->id)
+			return(1);
+		if (list[n]->id < m->id)
+			lo = n + 1;
+		else
+			hi = n;
+	}
+
+	return(0);
+}
+
+/*
+ * One of the client's properties has changed.  Throw away what was
+ * matched, unless nothing in the config looks at that property.
+ */
+void
+match_client_invalidate(struct client_ctx *cc, int field)
+{
+	if (field == MATCH_TYPE) {
+		free(cc->wintype);
+		cc->wintype = NULL;
+	}
+
+	/* The class always matters; it's what the index is keyed on. */
+	if (field != MATCH_CLASS && !(match_used & (1 << field)))
+		return;
+
+	cc->match_gen = 0;
+	rule_client_clear(cc);
+}
+
+void
+match_client_clear(struct client_ctx *cc)
+{
+	free(cc->matches);
+	cc->matches = NULL;
+	cc->nmatches = 0;
+	cc->match_gen = 0;
+	free(cc->wintype);
+	cc->wintype = NULL;
+}
+
+struct match *
+match_find_by_index(int idx)
+{
+	struct match	*m;
+
+	TAILQ_FOREACH(m, &matchq, entry) {
+		if (m->id == idx)
+			return(m);
+	}
+
+	return(NULL);
+}
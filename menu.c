@@ -20,15 +20,24 @@
  */
 
 #include <sys/types.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
 
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "calmwm.h"
@@ -36,12 +45,48 @@
 #define PROMPT_SCHAR	"\xc2\xbb"
 #define PROMPT_ECHAR	"\xc2\xab"
 
+#define MENU_SRC_BATCH	256
+
+#define MENU_CHUNK	(64 * 1024)
+#define MENU_ALIGN	8
+
 enum ctltype {
 	CTL_NONE = -1,
 	CTL_ERASEONE = 0, CTL_WIPE, CTL_UP, CTL_DOWN, CTL_RETURN,
 	CTL_TAB, CTL_ABORT, CTL_ALL
 };
 
+/*
+ * The results for one search string.  cand holds the same entries as res,
+ * but in menuq order, so it can be searched again as if it were menuq.
+ */
+struct menu_level {
+	size_t			 len;
+	int			 narrow;
+	struct menu		**res;
+	size_t			 nres;
+	struct menu		**cand;
+	size_t			 ncand;
+};
+
+/*
+ * Entries, with their text and folded text, are carved out of a list of
+ * chunks belonging to the menu_q, and all freed at once by menuq_clear().
+ */
+struct menu_chunk {
+	struct menu_chunk	*next;
+	size_t			 size;
+	size_t			 used;
+	char			 data[];
+};
+
+/* What was last drawn in one row of the menu. */
+struct menu_row {
+	struct menu		*mi;
+	uint64_t		 printhash;
+	int			 active;
+};
+
 struct menu_ctx {
 	struct screen_ctx	*sc;
 	char			 searchstr[MENU_MAXENTRY + 1];
@@ -59,19 +104,102 @@ struct menu_ctx {
 	struct geom		 geom;
 	void (*match)(struct menu_q *, struct menu_q *, char *);
 	void (*print)(struct menu *, int);
+	struct menu		**all;		/* menuq, as an array */
+	size_t			 nall;
+	struct menu_level	*levels;	/* one per prefix of stackstr */
+	size_t			 nlevels;
+	char			 stackstr[MENU_MAXENTRY + 1];
+	unsigned int		 mark;
+	struct menu		**rows;		/* resultq, as an array */
+	size_t			 nrows;
+	size_t			 nrowsalloc;
+	int			 rowsdirty;
+	size_t			 sel;		/* the selected row */
+	size_t			 top;		/* the first row shown */
+	size_t			 nshown;
+	int			 maxw;		/* widest row shown so far */
+	Pixmap			 pix;		/* drawn here, then copied */
+	int			 pixw;
+	int			 pixh;
+	GC			 gc;
+	struct geom		 drawn;		/* geometry pix was drawn at */
+	char			 drawnprompt[MENU_MAXENTRY*2 + 1];
+	struct menu_row		*drawnrows;
+	size_t			 ndrawnrows;
+	int			 ptrentry;	/* cursor is over an entry */
+	struct menu_q		*menuq;
+	struct menu_q		*resultq;
+	int			 refilter;	/* menuq changed under us */
+	struct menu		*keep;		/* row to stay selected */
+	int			 completing;	/* paths for compcmd */
+	char			 compcmd[MENU_MAXENTRY + 1];
+	struct menu_q		 compq;
+};
+
+/* The menu that is up, if any; there is only ever one. */
+static struct menu_ctx	*menu_open;
+
+/*
+ * A producer of menu entries, run on its own thread while the menu is up.
+ * Entries are handed over in batches on the pending queue, and the main
+ * thread is woken through fd.
+ */
+struct menu_src {
+	pthread_t		 thread;
+	pthread_mutex_t		 lock;
+	int			 fd;
+	int			 wfd;
+	atomic_int		 cancel;	/* read without the lock */
+	int			 done;		/* under lock */
+	struct menu_q		 pending;	/* under lock */
+	struct menu_q		 batch;		/* producer only */
+	size_t			 nbatch;
+	struct menu_chunk	*arena;		/* producer only */
+	void (*produce)(struct menu_src *, void *);
+	void			*arg;
 };
+
+static void		*menu_arena_alloc(struct menu_chunk **, size_t);
+static void		 menu_arena_free(struct menu_chunk *);
+static struct menu	*menu_new(struct menu_chunk **, void *, const char *,
+			     va_list);
+static struct menu	*menu_dummy(const char *);
+static const char	*menu_entry_text(struct menu_ctx *, struct menu *);
+static int		 menu_entry_width(struct menu_ctx *, struct menu_q *,
+			     struct menu *);
+static struct menu_src	*menu_src_start(void (*)(struct menu_src *, void *),
+			     void *);
+static void		*menu_src_run(void *);
+static int		 menu_src_flush(struct menu_src *);
+static int		 menu_src_drain(struct menu_src *, struct menu_q *,
+			     int *);
+static void		 menu_src_stop(struct menu_src *, struct menu_q *);
+static void		 menu_match(struct menu_ctx *, struct menu_q *,
+			     struct menu_q *);
+static void		 menu_match_from(struct menu_ctx *, struct menu_q *,
+			     struct menu_q *, struct menu **, size_t);
+static void		 menu_match_reset(struct menu_ctx *);
+static void		 menu_client_index(struct menu_q *, int);
+static void		 menu_refilter(struct menu_ctx *, struct menu_q *,
+			     struct menu_q *);
 static struct menu	*menu_handle_key(XEvent *, struct menu_ctx *,
 			     struct menu_q *, struct menu_q *);
-static void		 menu_handle_move(XEvent *, struct menu_ctx *,
-			     struct menu_q *);
+static void		 menu_handle_move(XEvent *, struct menu_ctx *);
 static struct menu	*menu_handle_release(XEvent *, struct menu_ctx *,
-			     struct menu_q *);
+			     struct menu_q *, struct menu_q *);
+static void		 menu_rows_update(struct menu_ctx *, struct menu_q *);
+static struct menu	*menu_entry_row(struct menu_ctx *, int);
 static void		 menu_draw(struct menu_ctx *, struct menu_q *,
 			     struct menu_q *);
-static void 		 menu_draw_entry(struct menu_ctx *, struct menu_q *,
-			     int, int);
+static void		 menu_draw_rows(struct menu_ctx *, int);
+static void		 menu_draw_row(struct menu_ctx *, int, const char *,
+			     int);
+static int		 menu_row_active(struct menu_ctx *, int);
+static void		 menu_expose(struct menu_ctx *, XExposeEvent *);
 static int		 menu_calc_entry(struct menu_ctx *, int, int);
-static struct menu 	*menu_complete_path(struct menu_ctx *);
+static void		 menu_complete_path(struct menu_ctx *);
+static struct menu	*menu_complete_done(struct menu_ctx *,
+			     struct menu *);
 static int		 menu_keycode(XKeyEvent *, enum ctltype *, char *);
 
 struct menu *
@@ -79,10 +207,29 @@ menu_filter(struct screen_ctx *sc, struct menu_q *menuq, const char *prompt,
     const char *initial, int flags,
     void (*match)(struct menu_q *, struct menu_q *, char *),
     void (*print)(struct menu *, int))
+{
+	return(menu_filter_src(sc, menuq, prompt, initial, flags, match, print,
+	    NULL, NULL));
+}
+
+/*
+ * As menu_filter, but menuq is filled in by produce, which is run on a
+ * separate thread while the menu is already up.  Entries are added to
+ * menuq, and the results filtered again, as they arrive.
+ */
+struct menu *
+menu_filter_src(struct screen_ctx *sc, struct menu_q *menuq,
+    const char *prompt, const char *initial, int flags,
+    void (*match)(struct menu_q *, struct menu_q *, char *),
+    void (*print)(struct menu *, int),
+    void (*produce)(struct menu_src *, void *), void *arg)
 {
 	struct menu_ctx		 mc;
 	struct menu_q		 resultq;
 	struct menu		*mi = NULL;
+	struct menu_src		*ms = NULL;
+	struct pollfd		 pfd[2];
+	int			 done;
 	struct config_screen	*cscr = sc->config_screen;
 	struct config_group	*cgrp = sc->group_current->config_group;
 	XEvent			 e;
@@ -92,7 +239,17 @@ menu_filter(struct screen_ctx *sc, struct menu_q *menuq, const char *prompt,
 	int			 evmask, focusrevert;
 	int			 xsave, ysave, xcur, ycur;
 
-	TAILQ_INIT(&resultq);
+	/*
+	 * Events are handled while a menu is up, and something they run
+	 * (a rule's action, say) may ask for another.  The window, drawing
+	 * and grabs are the screen's, so that one can't have them.
+	 */
+	if (menu_open != NULL) {
+		log_debug("%s: a menu is already open", __func__);
+		return(NULL);
+	}
+
+	menuq_init(&resultq);
 
 	(void)memset(&mc, 0, sizeof(mc));
 
@@ -101,6 +258,9 @@ menu_filter(struct screen_ctx *sc, struct menu_q *menuq, const char *prompt,
 	    cgrp->xftcolor[CWM_COLOR_MENU_FG].pixel,
 	    cgrp->xftcolor[CWM_COLOR_MENU_BG].pixel);
 
+	/* Everything is copied from mc.pix, so the server needn't clear. */
+	XSetWindowBackgroundPixmap(X_Dpy, sc->menuwin, None);
+
 	sc->xftdraw = XftDrawCreate(X_Dpy, sc->menuwin, visual, colormap);
 	if (sc->xftdraw == NULL)
 		log_fatal("XftDrawCreate() failed");
@@ -130,11 +290,17 @@ menu_filter(struct screen_ctx *sc, struct menu_q *menuq, const char *prompt,
 		mc.hasprompt = 1;
 	}
 
+	/* Get the producer going before anything else. */
+	if (produce != NULL)
+		ms = menu_src_start(produce, arg);
+
 	XSelectInput(X_Dpy, sc->menuwin, evmask);
 	XMapRaised(X_Dpy, sc->menuwin);
 
 	if (xu_ptr_grab(sc->menuwin, MENUGRABMASK,
 	    cscr->cursor[CF_QUESTION]) < 0) {
+		if (ms != NULL)
+			menu_src_stop(ms, menuq);
 		XUnmapWindow(X_Dpy, sc->menuwin);
 		return(NULL);
 	}
@@ -146,26 +312,86 @@ menu_filter(struct screen_ctx *sc, struct menu_q *menuq, const char *prompt,
 	XGrabKeyboard(X_Dpy, sc->menuwin, True,
 	    GrabModeAsync, GrabModeAsync, CurrentTime);
 
+	mc.menuq = menuq;
+	mc.resultq = &resultq;
+	menu_open = &mc;
+	if (mc.flags & CWM_MENU_WINDOW)
+		menu_client_index(menuq, 1);
+
+	/*
+	 * Everything not meant for the menu is handled as it would be
+	 * without it, so clients can still map, configure and so on.
+	 */
 	for (;;) {
 		mc.changed = 0;
 
-		XWindowEvent(X_Dpy, sc->menuwin, evmask, &e);
+		if (mc.refilter) {
+			mc.refilter = 0;
+			menu_refilter(&mc, mc.menuq, &resultq);
+		}
+
+		if (ms != NULL && XPending(X_Dpy) == 0) {
+			pfd[0].fd = ConnectionNumber(X_Dpy);
+			pfd[0].events = POLLIN;
+			pfd[1].fd = ms->fd;
+			pfd[1].events = POLLIN;
+			if (poll(pfd, 2, -1) == -1 && errno != EINTR)
+				log_debug("%s: poll: %s", __func__,
+				    strerror(errno));
+			if ((pfd[1].revents & POLLIN) == 0)
+				continue;
+
+			/* Completing a path, the producer's entries wait. */
+			if (menu_src_drain(ms, menuq, &done) &&
+			    !mc.completing)
+				menu_refilter(&mc, mc.menuq, &resultq);
+			if (done) {
+				menu_src_stop(ms, menuq);
+				ms = NULL;
+			}
+			continue;
+		}
+
+		XNextEvent(X_Dpy, &e);
+		if (e.xany.window != sc->menuwin) {
+			switch (e.type) {
+			case KeyPress:
+			case KeyRelease:
+			case ButtonPress:
+			case ButtonRelease:
+			case MotionNotify:
+			case EnterNotify:
+			case LeaveNotify:
+				/* Input belongs to the menu while it's up. */
+				break;
+			default:
+				xev_dispatch(&e);
+				break;
+			}
+			continue;
+		}
 
 		switch (e.type) {
 		case KeyPress:
-			if ((mi = menu_handle_key(&e, &mc, menuq, &resultq))
-			    != NULL)
+			if ((mi = menu_handle_key(&e, &mc, mc.menuq,
+			    &resultq)) != NULL)
 				goto out;
-			/* FALLTHROUGH */
+			/* The keyboard has the highlight until the mouse moves. */
+			mc.entry = -1;
+			menu_draw(&mc, mc.menuq, &resultq);
+			break;
 		case Expose:
-			menu_draw(&mc, menuq, &resultq);
+			if (mc.pix == None)
+				menu_draw(&mc, mc.menuq, &resultq);
+			else
+				menu_expose(&mc, &e.xexpose);
 			break;
 		case MotionNotify:
-			menu_handle_move(&e, &mc, &resultq);
+			menu_handle_move(&e, &mc);
 			break;
 		case ButtonRelease:
-			if ((mi = menu_handle_release(&e, &mc, &resultq))
-			    != NULL)
+			if ((mi = menu_handle_release(&e, &mc, mc.menuq,
+			    &resultq)) != NULL)
 				goto out;
 			break;
 		default:
@@ -173,6 +399,23 @@ menu_filter(struct screen_ctx *sc, struct menu_q *menuq, const char *prompt,
 		}
 	}
 out:
+	menu_open = NULL;
+	if (mc.flags & CWM_MENU_WINDOW)
+		menu_client_index(menuq, 0);
+	if (ms != NULL)
+		menu_src_stop(ms, menuq);
+	menu_match_reset(&mc);
+	if (mc.completing) {
+		mi = menu_complete_done(&mc, mi);
+		menuq_clear(&mc.compq);
+	}
+	free(mc.rows);
+	free(mc.drawnrows);
+	if (mc.pix != None) {
+		XFreePixmap(X_Dpy, mc.pix);
+		XFreeGC(X_Dpy, mc.gc);
+	}
+
 	if ((mc.flags & CWM_MENU_DUMMY) == 0 && mi->dummy) {
 	       	/* no mouse based match */
 		free(mi);
@@ -193,30 +436,365 @@ out:
 	return(mi);
 }
 
-static struct menu *
-menu_complete_path(struct menu_ctx *mc)
+static struct menu_src *
+menu_src_start(void (*produce)(struct menu_src *, void *), void *arg)
+{
+	struct menu_src	*ms;
+#if !defined(__linux__)
+	int		 fds[2];
+#endif
+	int		 error;
+
+	ms = xcalloc(1, sizeof(*ms));
+	ms->produce = produce;
+	ms->arg = arg;
+	TAILQ_INIT(&ms->pending);
+	TAILQ_INIT(&ms->batch);
+	pthread_mutex_init(&ms->lock, NULL);
+
+#if defined(__linux__)
+	if ((ms->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+		log_fatal("%s: eventfd: %s", __func__, strerror(errno));
+	ms->wfd = ms->fd;
+#else
+	if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1)
+		log_fatal("%s: pipe: %s", __func__, strerror(errno));
+	ms->fd = fds[0];
+	ms->wfd = fds[1];
+#endif
+
+	if ((error = pthread_create(&ms->thread, NULL, menu_src_run, ms)) != 0)
+		log_fatal("%s: pthread_create: %s", __func__, strerror(error));
+
+	return(ms);
+}
+
+static void *
+menu_src_run(void *arg)
+{
+	struct menu_src	*ms = arg;
+	uint64_t	 one = 1;
+
+	(*ms->produce)(ms, ms->arg);
+	(void)menu_src_flush(ms);
+
+	pthread_mutex_lock(&ms->lock);
+	ms->done = 1;
+	pthread_mutex_unlock(&ms->lock);
+	(void)write(ms->wfd, &one, sizeof(one));
+
+	return(NULL);
+}
+
+/*
+ * Add an entry from a producer.  Returns -1 once the menu has gone away,
+ * after which the producer should stop.
+ */
+int
+menu_src_add(struct menu_src *ms, void *ctx, const char *fmt, ...)
 {
-	struct menu		*mi, *mr;
-	struct menu_q		 menuq;
+	va_list		 ap;
+	struct menu	*mi;
+
+	if (menu_src_cancelled(ms))
+		return(-1);
+
+	va_start(ap, fmt);
+	mi = menu_new(&ms->arena, ctx, fmt, ap);
+	va_end(ap);
 
-	mr = xcalloc(1, sizeof(*mr));
+	TAILQ_INSERT_TAIL(&ms->batch, mi, entry);
+	if (++ms->nbatch < MENU_SRC_BATCH)
+		return(0);
 
-	TAILQ_INIT(&menuq);
+	return(menu_src_flush(ms));
+}
 
-	if ((mi = menu_filter(mc->sc, &menuq, mc->searchstr, NULL,
-	    CWM_MENU_DUMMY, search_match_path_any, NULL)) != NULL) {
-		mr->abort = mi->abort;
-		mr->dummy = mi->dummy;
-		if (mi->text[0] != '\0')
-			snprintf(mr->text, sizeof(mr->text), "%s \"%s\"",
-			    mc->searchstr, mi->text);
-		else if (!mr->abort)
-			strlcpy(mr->text, mc->searchstr, sizeof(mr->text));
+static int
+menu_src_flush(struct menu_src *ms)
+{
+	struct menu	*mi;
+	uint64_t	 one = 1;
+
+	if (ms->nbatch == 0)
+		return(0);
+
+	pthread_mutex_lock(&ms->lock);
+	while ((mi = TAILQ_FIRST(&ms->batch)) != NULL) {
+		TAILQ_REMOVE(&ms->batch, mi, entry);
+		TAILQ_INSERT_TAIL(&ms->pending, mi, entry);
 	}
-	
-	menuq_clear(&menuq);
+	pthread_mutex_unlock(&ms->lock);
+	ms->nbatch = 0;
+
+	(void)write(ms->wfd, &one, sizeof(one));
 
-	return(mr);
+	return(menu_src_cancelled(ms) ? -1 : 0);
+}
+
+/*
+ * Has the menu gone away?  Cheap enough for a producer to ask about every
+ * entry, or between slow steps that add nothing.
+ */
+int
+menu_src_cancelled(struct menu_src *ms)
+{
+	return(atomic_load_explicit(&ms->cancel, memory_order_relaxed));
+}
+
+/*
+ * Move whatever has arrived onto menuq.  Returns 1 if there was anything;
+ * done is set once the producer has finished.
+ */
+static int
+menu_src_drain(struct menu_src *ms, struct menu_q *menuq, int *done)
+{
+	struct menu	*mi;
+	uint64_t	 n;
+	int		 added = 0;
+
+	while (read(ms->fd, &n, sizeof(n)) > 0)
+		;
+
+	pthread_mutex_lock(&ms->lock);
+	while ((mi = TAILQ_FIRST(&ms->pending)) != NULL) {
+		TAILQ_REMOVE(&ms->pending, mi, entry);
+		TAILQ_INSERT_TAIL(menuq, mi, entry);
+		added = 1;
+	}
+	if (done != NULL)
+		*done = ms->done;
+	pthread_mutex_unlock(&ms->lock);
+
+	return(added);
+}
+
+static void
+menu_src_stop(struct menu_src *ms, struct menu_q *menuq)
+{
+	atomic_store(&ms->cancel, 1);
+	pthread_join(ms->thread, NULL);
+
+	/*
+	 * Whatever is left belongs to menuq, as does the memory it all
+	 * came from, so the caller frees it.
+	 */
+	(void)menu_src_drain(ms, menuq, NULL);
+	if (ms->arena != NULL) {
+		struct menu_chunk	*mk;
+
+		for (mk = ms->arena; mk->next != NULL; mk = mk->next)
+			;
+		mk->next = menuq->arena;
+		menuq->arena = ms->arena;
+	}
+
+	(void)close(ms->fd);
+	if (ms->wfd != ms->fd)
+		(void)close(ms->wfd);
+	pthread_mutex_destroy(&ms->lock);
+	free(ms);
+}
+
+/*
+ * Run the match function for the current search string.
+ *
+ * The results for each prefix of the search are kept on a stack.  Typing
+ * another character only searches the previous results, and backspace just
+ * goes back to the results already on the stack.  Narrowing is only safe
+ * when the results came from menuq and the search has no glob characters,
+ * since those make the match functions non-monotonic.
+ */
+static void
+menu_match(struct menu_ctx *mc, struct menu_q *menuq, struct menu_q *resultq)
+{
+	struct menu_level	*ml, *prev = NULL;
+	struct menu		*mi, **src;
+	struct timespec		 t0, t1;
+	const char		*s = mc->searchstr;
+	size_t			 i, n, len, cp, nsrc;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	len = strlen(s);
+	for (cp = 0; cp < len && s[cp] == mc->stackstr[cp]; cp++)
+		;
+	while (mc->nlevels > 0 && mc->levels[mc->nlevels - 1].len > cp) {
+		ml = &mc->levels[--mc->nlevels];
+		free(ml->res);
+		free(ml->cand);
+	}
+	if (mc->nlevels > 0)
+		prev = &mc->levels[mc->nlevels - 1];
+
+	if (prev != NULL && prev->len == len) {
+		/*
+		 * The match functions leave state on the entries they match
+		 * (the client search's matchname), which the longer search
+		 * has since overwritten.  Search the candidates again to get
+		 * it back; the results come out the same.
+		 */
+		if (prev->narrow) {
+			menu_match_from(mc, menuq, resultq, prev->cand,
+			    prev->ncand);
+			nsrc = prev->ncand;
+		} else {
+			TAILQ_INIT(resultq);
+			for (i = 0; i < prev->nres; i++)
+				TAILQ_INSERT_TAIL(resultq, prev->res[i],
+				    resultentry);
+			nsrc = 0;
+		}
+		goto done;
+	}
+
+	if (mc->all == NULL) {
+		n = 0;
+		TAILQ_FOREACH(mi, menuq, entry)
+			n++;
+		mc->all = xreallocarray(NULL, n, sizeof(*mc->all));
+		mc->nall = 0;
+		TAILQ_FOREACH(mi, menuq, entry)
+			mc->all[mc->nall++] = mi;
+	}
+	if (mc->levels == NULL)
+		mc->levels = xcalloc(MENU_MAXENTRY + 1, sizeof(*mc->levels));
+
+	if (prev != NULL && prev->narrow && strpbrk(s, "*?[\\") == NULL) {
+		src = prev->cand;
+		nsrc = prev->ncand;
+		menu_match_from(mc, menuq, resultq, src, nsrc);
+	} else {
+		src = mc->all;
+		nsrc = mc->nall;
+		(*mc->match)(menuq, resultq, mc->searchstr);
+	}
+
+	ml = &mc->levels[mc->nlevels++];
+	memset(ml, 0, sizeof(*ml));
+	ml->len = len;
+
+	mc->mark++;
+	n = 0;
+	TAILQ_FOREACH(mi, resultq, resultentry) {
+		mi->mark = mc->mark;
+		n++;
+	}
+	ml->res = xreallocarray(NULL, n, sizeof(*ml->res));
+	TAILQ_FOREACH(mi, resultq, resultentry)
+		ml->res[ml->nres++] = mi;
+
+	ml->cand = xreallocarray(NULL, n, sizeof(*ml->cand));
+	for (i = 0; i < nsrc && ml->ncand < n; i++) {
+		if (src[i]->mark == mc->mark)
+			ml->cand[ml->ncand++] = src[i];
+	}
+	/* Anything that wasn't in menuq (e.g. paths) can't be narrowed. */
+	ml->narrow = (ml->ncand == ml->nres);
+
+	(void)strlcpy(mc->stackstr, s, sizeof(mc->stackstr));
+done:
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	log_debug("%s: '%s': searched %zu, %zu levels, %ld us", __func__, s,
+	    nsrc, mc->nlevels, (long)((t1.tv_sec - t0.tv_sec) * 1000000 +
+	    (t1.tv_nsec - t0.tv_nsec) / 1000));
+}
+
+/* Run the match function over just src, which is a subset of menuq. */
+static void
+menu_match_from(struct menu_ctx *mc, struct menu_q *menuq,
+    struct menu_q *resultq, struct menu **src, size_t nsrc)
+{
+	struct menu_q	 candq;
+	size_t		 i;
+
+	/* Borrow the entry links; menuq is put back afterwards. */
+	TAILQ_INIT(&candq);
+	for (i = 0; i < nsrc; i++)
+		TAILQ_INSERT_TAIL(&candq, src[i], entry);
+	(*mc->match)(&candq, resultq, mc->searchstr);
+	TAILQ_INIT(menuq);
+	for (i = 0; i < mc->nall; i++)
+		TAILQ_INSERT_TAIL(menuq, mc->all[i], entry);
+}
+
+/* Forget the result stack, as menuq has changed or the menu is done. */
+static void
+menu_match_reset(struct menu_ctx *mc)
+{
+	while (mc->nlevels > 0) {
+		mc->nlevels--;
+		free(mc->levels[mc->nlevels].res);
+		free(mc->levels[mc->nlevels].cand);
+	}
+	free(mc->levels);
+	mc->levels = NULL;
+	free(mc->all);
+	mc->all = NULL;
+	mc->nall = 0;
+	mc->stackstr[0] = '\0';
+}
+
+/*
+ * Filter again from scratch, after menuq has changed, and redraw; the
+ * selection stays where it was if that row is still there.
+ */
+static void
+menu_refilter(struct menu_ctx *mc, struct menu_q *menuq,
+    struct menu_q *resultq)
+{
+	if (mc->sel < mc->nrows)
+		mc->keep = mc->rows[mc->sel];
+	menu_match_reset(mc);
+	if (mc->searchstr[0] != '\0') {
+		menu_match(mc, menuq, resultq);
+		mc->noresult = TAILQ_EMPTY(resultq) && !TAILQ_EMPTY(menuq);
+	} else
+		TAILQ_INIT(resultq);
+	mc->rowsdirty = 1;
+	menu_draw(mc, menuq, resultq);
+}
+
+/*
+ * The exec menu's search is a command; go on to complete a path for it in
+ * the same menu, with the command as the prompt.  Only one menu may be up.
+ */
+static void
+menu_complete_path(struct menu_ctx *mc)
+{
+	(void)strlcpy(mc->compcmd, mc->searchstr, sizeof(mc->compcmd));
+	(void)strlcpy(mc->promptstr, mc->searchstr, sizeof(mc->promptstr));
+	mc->hasprompt = 1;
+	mc->searchstr[0] = '\0';
+	mc->flags &= ~CWM_MENU_FILE;
+	mc->match = search_match_path_any;
+	mc->completing = 1;
+
+	menu_match_reset(mc);
+	menuq_init(&mc->compq);
+	mc->menuq = &mc->compq;
+	mc->sel = mc->top = 0;
+	mc->changed = 1;
+}
+
+/* Turn what was picked while completing into the command line. */
+static struct menu *
+menu_complete_done(struct menu_ctx *mc, struct menu *mi)
+{
+	char	 text[MENU_MAXENTRY + 1];
+
+	if (mi->abort)
+		return(mi);
+
+	if (mi->text[0] != '\0')
+		(void)snprintf(text, sizeof(text), "%s \"%s\"", mc->compcmd,
+		    mi->text);
+	else
+		(void)strlcpy(text, mc->compcmd, sizeof(text));
+	if (mi->dummy)
+		free(mi);
+
+	return(menu_dummy(text));
 }
 
 static struct menu *
@@ -226,13 +804,15 @@ menu_handle_key(XEvent *e, struct menu_ctx *mc, struct menu_q *menuq,
 	struct menu	*mi;
 	enum ctltype	 ctl;
 	char		 chr[32];
-	size_t		 len;
+	size_t		 len, j;
 	int 		 clen, i;
 	wchar_t 	 wc;
 
 	if (menu_keycode(&e->xkey, &ctl, chr) < 0)
 		return(NULL);
 
+	menu_rows_update(mc, resultq);
+
 	switch (ctl) {
 	case CTL_ERASEONE:
 		if ((len = strlen(mc->searchstr)) > 0) {
@@ -245,32 +825,22 @@ menu_handle_key(XEvent *e, struct menu_ctx *mc, struct menu_q *menuq,
 		}
 		break;
 	case CTL_UP:
-		mi = TAILQ_LAST(resultq, menu_q);
-		if (mi == NULL)
-			break;
-
-		TAILQ_REMOVE(resultq, mi, resultentry);
-		TAILQ_INSERT_HEAD(resultq, mi, resultentry);
+		if (mc->nrows > 0)
+			mc->sel = (mc->sel > 0) ? mc->sel - 1 : mc->nrows - 1;
 		break;
 	case CTL_DOWN:
-		mi = TAILQ_FIRST(resultq);
-		if (mi == NULL)
-			break;
-
-		TAILQ_REMOVE(resultq, mi, resultentry);
-		TAILQ_INSERT_TAIL(resultq, mi, resultentry);
+		if (mc->nrows > 0)
+			mc->sel = (mc->sel + 1) % mc->nrows;
 		break;
 	case CTL_RETURN:
 		/*
 		 * Return whatever the cursor is currently on. Else
 		 * even if dummy is zero, we need to return something.
 		 */
-		if ((mi = TAILQ_FIRST(resultq)) == NULL) {
-			mi = xmalloc(sizeof(*mi));
-			(void)strlcpy(mi->text,
-			    mc->searchstr, sizeof(mi->text));
-			mi->dummy = 1;
-		}
+		if (mc->nrows > 0)
+			mi = mc->rows[mc->sel];
+		else
+			mi = menu_dummy(mc->searchstr);
 		mi->abort = 0;
 		return(mi);
 	case CTL_WIPE:
@@ -278,7 +848,8 @@ menu_handle_key(XEvent *e, struct menu_ctx *mc, struct menu_q *menuq,
 		mc->changed = 1;
 		break;
 	case CTL_TAB:
-		if ((mi = TAILQ_FIRST(resultq)) != NULL) {
+		if (mc->nrows > 0) {
+			mi = mc->rows[mc->sel];
 			/*
 			 * - We are in exec_path menu mode
 			 * - It is equal to the input
@@ -286,17 +857,22 @@ menu_handle_key(XEvent *e, struct menu_ctx *mc, struct menu_q *menuq,
 			 */
 			if ((mc->flags & CWM_MENU_FILE) &&
 			    (strncmp(mc->searchstr, mi->text,
-					strlen(mi->text))) == 0)
-				return(menu_complete_path(mc));
+					strlen(mi->text))) == 0) {
+				menu_complete_path(mc);
+				menuq = mc->menuq;
+				break;
+			}
 
 			/*
 			 * Put common prefix of the results into searchstr
 			 */
 			(void)strlcpy(mc->searchstr,
 					mi->text, sizeof(mc->searchstr));
-			while ((mi = TAILQ_NEXT(mi, resultentry)) != NULL) {
+			for (j = 0; j < mc->nrows; j++) {
+				mi = mc->rows[j];
 				i = 0;
-				while (tolower(mc->searchstr[i]) ==
+				while (mc->searchstr[i] != '\0' &&
+				    tolower(mc->searchstr[i]) ==
 					       tolower(mi->text[i]))
 					i++;
 				mc->searchstr[i] = '\0';
@@ -308,9 +884,7 @@ menu_handle_key(XEvent *e, struct menu_ctx *mc, struct menu_q *menuq,
 		mc->list = !mc->list;
 		break;
 	case CTL_ABORT:
-		mi = xmalloc(sizeof(*mi));
-		mi->text[0] = '\0';
-		mi->dummy = 1;
+		mi = menu_dummy("");
 		mi->abort = 1;
 		return(mi);
 	default:
@@ -324,20 +898,61 @@ menu_handle_key(XEvent *e, struct menu_ctx *mc, struct menu_q *menuq,
 
 	mc->noresult = 0;
 	if (mc->changed && mc->searchstr[0] != '\0') {
-		(*mc->match)(menuq, resultq, mc->searchstr);
+		menu_match(mc, menuq, resultq);
 		/* If menuq is empty, never show we've failed */
 		mc->noresult = TAILQ_EMPTY(resultq) && !TAILQ_EMPTY(menuq);
-	} else if (mc->changed)
+		mc->rowsdirty = 1;
+	} else if (mc->changed) {
 		TAILQ_INIT(resultq);
+		mc->rowsdirty = 1;
+	}
 
 	if (!mc->list && mc->listing && !mc->changed) {
 		TAILQ_INIT(resultq);
 		mc->listing = 0;
+		mc->rowsdirty = 1;
 	}
 
 	return(NULL);
 }
 
+static void
+menu_rows_update(struct menu_ctx *mc, struct menu_q *resultq)
+{
+	struct menu	*mi;
+	size_t		 i;
+
+	if (!mc->rowsdirty)
+		return;
+
+	mc->nrows = 0;
+	TAILQ_FOREACH(mi, resultq, resultentry) {
+		if (mc->nrows == mc->nrowsalloc) {
+			mc->nrowsalloc = mc->nrowsalloc ?
+			    mc->nrowsalloc * 2 : 64;
+			mc->rows = xreallocarray(mc->rows, mc->nrowsalloc,
+			    sizeof(*mc->rows));
+		}
+		mc->rows[mc->nrows++] = mi;
+	}
+	mc->sel = mc->top = 0;
+	if (mc->keep != NULL) {
+		for (i = 0; i < mc->nrows; i++) {
+			if (mc->rows[i] == mc->keep) {
+				mc->sel = i;
+				break;
+			}
+		}
+		mc->keep = NULL;
+	}
+	mc->maxw = 0;
+	mc->rowsdirty = 0;
+}
+
+/*
+ * Lay out and draw the rows that fit on the screen, scrolled so that the
+ * selected row is one of them.
+ */
 static void
 menu_draw(struct menu_ctx *mc, struct menu_q *menuq, struct menu_q *resultq)
 {
@@ -345,7 +960,10 @@ menu_draw(struct menu_ctx *mc, struct menu_q *menuq, struct menu_q *resultq)
 	struct config_group	*cgrp = sc->group_current->config_group;
 	struct menu		*mi;
 	struct geom		 xine;
-	int			 n, xsave, ysave;
+	XGCValues		 gcv = { .graphics_exposures = False };
+	Pixmap			 oldpix;
+	size_t			 i;
+	int			 rowh, maxrows, xsave, ysave, full;
 
 	if (mc->list) {
 		if (TAILQ_EMPTY(resultq)) {
@@ -354,9 +972,26 @@ menu_draw(struct menu_ctx *mc, struct menu_q *menuq, struct menu_q *resultq)
 				TAILQ_INSERT_TAIL(resultq, mi, resultentry);
 
 			mc->listing = 1;
+			mc->rowsdirty = 1;
 		} else if (mc->changed)
 			mc->listing = 0;
 	}
+	menu_rows_update(mc, resultq);
+
+	xine = screen_find_xinerama(mc->geom.x, mc->geom.y, CWM_GAP);
+	xine.w += xine.x - cgrp->bwidth * 2;
+	xine.h += xine.y - cgrp->bwidth * 2;
+
+	rowh = cgrp->xftfont->height + 1;
+	maxrows = MAX((xine.h - xine.y) / rowh - mc->hasprompt, 1);
+
+	mc->nshown = MIN(mc->nrows, (size_t)maxrows);
+	if (mc->sel < mc->top)
+		mc->top = mc->sel;
+	else if (mc->nshown > 0 && mc->sel >= mc->top + mc->nshown)
+		mc->top = mc->sel - mc->nshown + 1;
+	if (mc->top + mc->nshown > mc->nrows)
+		mc->top = mc->nrows - mc->nshown;
 
 	mc->num = 0;
 	mc->geom.w = 0;
@@ -366,30 +1001,17 @@ menu_draw(struct menu_ctx *mc, struct menu_q *menuq, struct menu_q *resultq)
 		    mc->promptstr, PROMPT_SCHAR, mc->searchstr, PROMPT_ECHAR);
 		mc->geom.w = xu_xft_width(cgrp->xftfont, mc->dispstr,
 		    strlen(mc->dispstr));
-		mc->geom.h = cgrp->xftfont->height + 1;
+		mc->geom.h = rowh;
 		mc->num = 1;
 	}
 
-	TAILQ_FOREACH(mi, resultq, resultentry) {
-		char *text;
-
-		if (mc->print != NULL) {
-			(*mc->print)(mi, mc->listing);
-			text = mi->print;
-		} else {
-			mi->print[0] = '\0';
-			text = mi->text;
-		}
-
-		mc->geom.w = MAX(mc->geom.w, xu_xft_width(cgrp->xftfont, text,
-		    MIN(strlen(text), MENU_MAXENTRY)));
-		mc->geom.h += cgrp->xftfont->height + 1;
-		mc->num++;
-	}
-
-	xine = screen_find_xinerama(mc->geom.x, mc->geom.y, CWM_GAP);
-	xine.w += xine.x - cgrp->bwidth * 2;
-	xine.h += xine.y - cgrp->bwidth * 2;
+	/* Keep the widest row seen, so scrolling doesn't jiggle the menu. */
+	for (i = mc->top; i < mc->top + mc->nshown; i++)
+		mc->maxw = MAX(mc->maxw, menu_entry_width(mc, menuq,
+		    mc->rows[i]));
+	mc->geom.w = MAX(mc->geom.w, mc->maxw);
+	mc->geom.h += mc->nshown * rowh;
+	mc->num += mc->nshown;
 
 	xsave = mc->geom.x;
 	ysave = mc->geom.y;
@@ -411,101 +1033,182 @@ menu_draw(struct menu_ctx *mc, struct menu_q *menuq, struct menu_q *resultq)
 	if (mc->geom.x != xsave || mc->geom.y != ysave)
 		xu_ptr_setpos(sc->rootwin, mc->geom.x, mc->geom.y);
 
-	XClearWindow(X_Dpy, sc->menuwin);
-	XMoveResizeWindow(X_Dpy, sc->menuwin, mc->geom.x, mc->geom.y,
-	    mc->geom.w, mc->geom.h);
+	full = (mc->geom.w != mc->drawn.w || mc->geom.h != mc->drawn.h);
+	if (mc->pix == None || mc->geom.w > mc->pixw || mc->geom.h > mc->pixh) {
+		oldpix = mc->pix;
+		if (oldpix == None)
+			mc->gc = XCreateGC(X_Dpy, sc->menuwin,
+			    GCGraphicsExposures, &gcv);
+		mc->pixw = MAX(MAX(mc->geom.w, mc->pixw), 1);
+		mc->pixh = MAX(MAX(mc->geom.h, mc->pixh), 1);
+		mc->pix = XCreatePixmap(X_Dpy, sc->menuwin, mc->pixw,
+		    mc->pixh, DefaultDepth(X_Dpy, sc->which));
+		XftDrawChange(sc->xftdraw, mc->pix);
+		if (oldpix != None)
+			XFreePixmap(X_Dpy, oldpix);
+		full = 1;
+	}
+	if (mc->geom.x != mc->drawn.x || mc->geom.y != mc->drawn.y || full)
+		XMoveResizeWindow(X_Dpy, sc->menuwin, mc->geom.x, mc->geom.y,
+		    mc->geom.w, mc->geom.h);
+	mc->drawn = mc->geom;
 
-	if (mc->hasprompt) {
-		xu_xft_draw(sc, mc->dispstr, CWM_COLOR_MENU_FONT,
-		    0, cgrp->xftfont->ascent);
-		n = 1;
-	} else
-		n = 0;
+	menu_draw_rows(mc, full);
+}
 
-	TAILQ_FOREACH(mi, resultq, resultentry) {
-		char *text = mi->print[0] != '\0' ?
-		    mi->print : mi->text;
-		int y = n * (cgrp->xftfont->height + 1) + cgrp->xftfont->ascent + 1;
+/*
+ * Bring the rows in the pixmap up to date, and copy the ones that changed
+ * to the window.  The whole menu is drawn again if full is set.
+ */
+static void
+menu_draw_rows(struct menu_ctx *mc, int full)
+{
+	struct screen_ctx	*sc = mc->sc;
+	struct config_group	*cgrp = sc->group_current->config_group;
+	struct menu_row		*mr;
+	struct menu		*mi;
+	int			 n, rowh, active, first = -1, last = -1;
 
-		/* Stop drawing when menu doesn't fit inside the screen. */
-		if (mc->geom.y + y > xine.h)
-			break;
+	rowh = cgrp->xftfont->height + 1;
 
-		xu_xft_draw(sc, text, CWM_COLOR_MENU_FONT, 0, y);
-		n++;
+	if ((size_t)mc->num > mc->ndrawnrows) {
+		mc->drawnrows = xreallocarray(mc->drawnrows, mc->num,
+		    sizeof(*mc->drawnrows));
+		mc->ndrawnrows = mc->num;
+		full = 1;
+	}
+	if (full)
+		XftDrawRect(sc->xftdraw, &cgrp->xftcolor[CWM_COLOR_MENU_BG],
+		    0, 0, mc->geom.w, mc->geom.h);
+
+	for (n = 0; n < mc->num; n++) {
+		if (n == 0 && mc->hasprompt) {
+			if (!full && strcmp(mc->drawnprompt, mc->dispstr) == 0)
+				continue;
+			(void)strlcpy(mc->drawnprompt, mc->dispstr,
+			    sizeof(mc->drawnprompt));
+			menu_draw_row(mc, 0, mc->dispstr, 0);
+		} else {
+			mi = menu_entry_row(mc, n);
+			active = menu_row_active(mc, n);
+			mr = &mc->drawnrows[n];
+			if (!full && mr->mi == mi && mr->active == active &&
+			    mr->printhash == mi->printhash)
+				continue;
+			mr->mi = mi;
+			mr->active = active;
+			mr->printhash = mi->printhash;
+			menu_draw_row(mc, n, menu_entry_text(mc, mi), active);
+		}
+		if (first == -1)
+			first = n;
+		last = n;
 	}
-	if (mc->hasprompt && n > 1)
-		menu_draw_entry(mc, resultq, 1, 1);
+
+	if (full)
+		XCopyArea(X_Dpy, mc->pix, sc->menuwin, mc->gc, 0, 0,
+		    mc->geom.w, mc->geom.h, 0, 0);
+	else if (first != -1)
+		XCopyArea(X_Dpy, mc->pix, sc->menuwin, mc->gc, 0, first * rowh,
+		    mc->geom.w, (last - first + 1) * rowh, 0, first * rowh);
 }
 
 static void
-menu_draw_entry(struct menu_ctx *mc, struct menu_q *resultq,
-    int entry, int active)
+menu_draw_row(struct menu_ctx *mc, int n, const char *text, int active)
 {
 	struct screen_ctx	*sc = mc->sc;
 	struct config_group	*cgrp = sc->group_current->config_group;
-	struct menu		*mi;
-	char 			*text;
-	int			 color, i = 0;
+	int			 rowh = cgrp->xftfont->height + 1;
+
+	XftDrawRect(sc->xftdraw, &cgrp->xftcolor[active ?
+	    CWM_COLOR_MENU_FG : CWM_COLOR_MENU_BG], 0, n * rowh,
+	    mc->geom.w, rowh);
+	/* The prompt sits one pixel higher than the entries. */
+	xu_xft_draw(sc, text, active ?
+	    CWM_COLOR_MENU_FONT_SEL : CWM_COLOR_MENU_FONT,
+	    0, n * rowh + cgrp->xftfont->ascent + (n > 0 || !mc->hasprompt));
+}
 
-	if (mc->hasprompt)
-		i = 1;
+/* The row under the pointer, or else the selection, is highlighted. */
+static int
+menu_row_active(struct menu_ctx *mc, int n)
+{
+	if (mc->entry != -1)
+		return(n == mc->entry);
+	return(mc->hasprompt && mc->nshown > 0 &&
+	    n == 1 + (int)(mc->sel - mc->top));
+}
 
-	TAILQ_FOREACH(mi, resultq, resultentry)
-		if (entry == i++)
-			break;
-	if (mi == NULL)
-		return;
+static void
+menu_expose(struct menu_ctx *mc, XExposeEvent *ee)
+{
+	XCopyArea(X_Dpy, mc->pix, mc->sc->menuwin, mc->gc, ee->x, ee->y,
+	    ee->width, ee->height, ee->x, ee->y);
+}
+
+/* The row shown at entry, as counted by menu_calc_entry(). */
+static struct menu *
+menu_entry_row(struct menu_ctx *mc, int entry)
+{
+	size_t	 i;
 
-	color = active ? CWM_COLOR_MENU_FG : CWM_COLOR_MENU_BG;
-	text = mi->print[0] != '\0' ? mi->print : mi->text;
-	XftDrawRect(sc->xftdraw, &cgrp->xftcolor[color], 0,
-	    (cgrp->xftfont->height + 1) * entry, mc->geom.w,
-	    (cgrp->xftfont->height + 1) + cgrp->xftfont->descent);
-	color = active ? CWM_COLOR_MENU_FONT_SEL : CWM_COLOR_MENU_FONT;
-	xu_xft_draw(sc, text, color,
-	    0, (cgrp->xftfont->height + 1) * entry + cgrp->xftfont->ascent + 1);
+	if (entry < mc->hasprompt)
+		return(NULL);
+	if ((i = entry - mc->hasprompt) >= mc->nshown)
+		return(NULL);
+
+	return(mc->rows[mc->top + i]);
 }
 
 static void
-menu_handle_move(XEvent *e, struct menu_ctx *mc, struct menu_q *resultq)
+menu_handle_move(XEvent *e, struct menu_ctx *mc)
 {
 	struct screen_ctx	*sc = mc->sc;
 	struct config_screen	*cscr = sc->config_screen;
+
 	mc->prev = mc->entry;
 	mc->entry = menu_calc_entry(mc, e->xbutton.x, e->xbutton.y);
 
 	if (mc->prev == mc->entry)
 		return;
 
-	if (mc->prev != -1)
-		menu_draw_entry(mc, resultq, mc->prev, 0);
-	if (mc->entry != -1) {
-		(void)xu_ptr_regrab(MENUGRABMASK, cscr->cursor[CF_NORMAL]);
-		menu_draw_entry(mc, resultq, mc->entry, 1);
-	} else
-		(void)xu_ptr_regrab(MENUGRABMASK, cscr->cursor[CF_DEFAULT]);
+	/* Only change the cursor on the way onto, or off, the entries. */
+	if ((mc->entry != -1) != mc->ptrentry) {
+		mc->ptrentry = (mc->entry != -1);
+		(void)xu_ptr_regrab(MENUGRABMASK, cscr->cursor[mc->ptrentry ?
+		    CF_NORMAL : CF_DEFAULT]);
+	}
+	menu_draw_rows(mc, 0);
 }
 
 static struct menu *
-menu_handle_release(XEvent *e, struct menu_ctx *mc, struct menu_q *resultq)
+menu_handle_release(XEvent *e, struct menu_ctx *mc, struct menu_q *menuq,
+    struct menu_q *resultq)
 {
 	struct menu		*mi;
-	int			 entry, i = 0;
-
-	entry = menu_calc_entry(mc, e->xbutton.x, e->xbutton.y);
-
-	if (mc->hasprompt)
-		i = 1;
-
-	TAILQ_FOREACH(mi, resultq, resultentry)
-		if (entry == i++)
-			break;
-	if (mi == NULL) {
-		mi = xmalloc(sizeof(*mi));
-		mi->text[0] = '\0';
-		mi->dummy = 1;
+	size_t			 last;
+
+	/* The wheel scrolls, keeping the selection on screen. */
+	if (e->xbutton.button == Button4 || e->xbutton.button == Button5) {
+		if (mc->nshown == 0)
+			return(NULL);
+		last = mc->nrows - mc->nshown;
+		if (e->xbutton.button == Button4 && mc->top > 0)
+			mc->top--;
+		else if (e->xbutton.button == Button5 && mc->top < last)
+			mc->top++;
+		else
+			return(NULL);
+		mc->sel = MAX(mc->sel, mc->top);
+		mc->sel = MIN(mc->sel, mc->top + mc->nshown - 1);
+		mc->entry = mc->prev = -1;
+		menu_draw(mc, menuq, resultq);
+		return(NULL);
 	}
+
+	if ((mi = menu_entry_row(mc, menu_calc_entry(mc, e->xbutton.x,
+	    e->xbutton.y))) == NULL)
+		mi = menu_dummy("");
 	return(mi);
 }
 
@@ -615,29 +1318,234 @@ menu_keycode(XKeyEvent *ev, enum ctltype *ctl, char *chr)
 	return(0);
 }
 
+static const char *
+menu_entry_text(struct menu_ctx *mc, struct menu *mi)
+{
+	return((mc->print != NULL && mi->print != NULL) ? mi->print : mi->text);
+}
+
+/*
+ * Print an entry, if the menu has a print function, and return how wide it
+ * is.  The width is only measured again if what's printed has changed.
+ */
+static int
+menu_entry_width(struct menu_ctx *mc, struct menu_q *menuq, struct menu *mi)
+{
+	struct config_group	*cgrp = mc->sc->group_current->config_group;
+	const char		*text;
+	uint64_t		 hash = 0;
+
+	if (mc->print != NULL) {
+		if (mi->print == NULL)
+			mi->print = menu_arena_alloc(&menuq->arena,
+			    MENU_MAXENTRY + 1);
+		(*mc->print)(mi, mc->listing);
+		hash = u_hash(mi->print, strlen(mi->print), 0);
+	}
+	if (mi->width != 0 && hash == mi->printhash)
+		return(mi->width);
+
+	text = menu_entry_text(mc, mi);
+	mi->width = xu_xft_width(cgrp->xftfont, text,
+	    MIN(strlen(text), MENU_MAXENTRY));
+	mi->printhash = hash;
+
+	return(mi->width);
+}
+
+static void *
+menu_arena_alloc(struct menu_chunk **arena, size_t len)
+{
+	struct menu_chunk	*mk = *arena;
+	void			*p;
+
+	len = (len + MENU_ALIGN - 1) & ~(size_t)(MENU_ALIGN - 1);
+
+	if (mk == NULL || mk->size - mk->used < len) {
+		mk = xmalloc(sizeof(*mk) + MAX(len, MENU_CHUNK));
+		mk->size = MAX(len, MENU_CHUNK);
+		mk->used = 0;
+		mk->next = *arena;
+		*arena = mk;
+	}
+	p = mk->data + mk->used;
+	mk->used += len;
+
+	return(p);
+}
+
+static void
+menu_arena_free(struct menu_chunk *mk)
+{
+	struct menu_chunk	*next;
+
+	for (; mk != NULL; mk = next) {
+		next = mk->next;
+		free(mk);
+	}
+}
+
+/*
+ * One allocation holds the entry, its text and, where folding changes it,
+ * the folded text.
+ */
+static struct menu *
+menu_new(struct menu_chunk **arena, void *ctx, const char *fmt, va_list ap)
+{
+	struct menu	*mi;
+	char		 text[MENU_MAXENTRY + 1], *fold;
+	size_t		 len, flen;
+
+	if (fmt != NULL)
+		(void)vsnprintf(text, sizeof(text), fmt, ap);
+	else
+		text[0] = '\0';
+	len = strlen(text) + 1;
+
+	fold = u_fold(text);
+	flen = (strcmp(fold, text) == 0) ? 0 : strlen(fold) + 1;
+
+	mi = menu_arena_alloc(arena, sizeof(*mi) + len + flen);
+	(void)memset(mi, 0, sizeof(*mi));
+	mi->ctx = ctx;
+	mi->text = (char *)(mi + 1);
+	(void)memcpy(mi->text, text, len);
+	if (flen > 0) {
+		mi->fold = mi->text + len;
+		(void)memcpy(mi->fold, fold, flen);
+	} else
+		mi->fold = mi->text;
+	free(fold);
+
+	return(mi);
+}
+
+/* An entry of its own, which the caller frees. */
+static struct menu *
+menu_dummy(const char *text)
+{
+	struct menu	*mi;
+	size_t		 len = strlen(text) + 1;
+
+	mi = xcalloc(1, sizeof(*mi) + len);
+	mi->text = (char *)(mi + 1);
+	(void)memcpy(mi->text, text, len);
+	mi->fold = mi->text;
+	mi->dummy = 1;
+
+	return(mi);
+}
+
+/*
+ * Keep the open menu in step with the clients: a windows menu picks up
+ * new clients, and any menu drops, or refilters, the entries of a client
+ * which has gone or changed.  The menu's loop does the refiltering.
+ *
+ * Only the menu's entries are looked after; callers holding a client
+ * across menu_filter() must look it up again afterwards.
+ */
+/*
+ * Point each client at its entry in the windows menu while it's up, so
+ * search can go from the trigram index's clients straight to entries.
+ */
+static void
+menu_client_index(struct menu_q *menuq, int on)
+{
+	struct menu		*mi;
+	struct client_ctx	*cc;
+
+	TAILQ_FOREACH(mi, menuq, entry) {
+		cc = mi->ctx;
+		cc->winmenu = on ? mi : NULL;
+	}
+}
+
+void
+menu_client_add(struct client_ctx *cc)
+{
+	struct menu_ctx	*mc = menu_open;
+
+	if (mc == NULL || (mc->flags & CWM_MENU_WINDOW) == 0)
+		return;
+	menuq_add(mc->menuq, cc, NULL);
+	cc->winmenu = TAILQ_LAST(mc->menuq, menu_q);
+	mc->refilter = 1;
+}
+
+void
+menu_client_remove(struct client_ctx *cc)
+{
+	struct menu_ctx	*mc = menu_open;
+	struct menu	*mi, *next;
+
+	if (mc == NULL)
+		return;
+	TAILQ_FOREACH_SAFE(mi, mc->menuq, entry, next) {
+		if (mi->ctx != cc)
+			continue;
+		TAILQ_REMOVE(mc->menuq, mi, entry);
+		cc->winmenu = NULL;
+		mc->refilter = 1;
+	}
+}
+
+void
+menu_client_update(struct client_ctx *cc)
+{
+	struct menu_ctx	*mc = menu_open;
+	struct menu	*mi;
+
+	if (mc == NULL)
+		return;
+	TAILQ_FOREACH(mi, mc->menuq, entry) {
+		if (mi->ctx == cc) {
+			mc->refilter = 1;
+			break;
+		}
+	}
+}
+
+void
+menuq_init(struct menu_q *mq)
+{
+	TAILQ_INIT(mq);
+	mq->arena = NULL;
+}
+
 void
 menuq_add(struct menu_q *mq, void *ctx, const char *fmt, ...)
 {
 	va_list		 ap;
 	struct menu	*mi;
 
-	mi = xcalloc(1, sizeof(*mi));
-	mi->ctx = ctx;
-
 	va_start(ap, fmt);
-	(void)vsnprintf(mi->text, sizeof(mi->text), fmt, ap);
+	mi = menu_new(&mq->arena, ctx, fmt, ap);
 	va_end(ap);
 
 	TAILQ_INSERT_TAIL(mq, mi, entry);
 }
 
+/*
+ * Add an entry to a match function's results which isn't in menuq, such
+ * as a path found by globbing.  It is freed along with menuq.
+ */
 void
-menuq_clear(struct menu_q *mq)
+menuq_add_result(struct menu_q *menuq, struct menu_q *resultq, void *ctx,
+    const char *fmt, ...)
 {
+	va_list		 ap;
 	struct menu	*mi;
 
-	while ((mi = TAILQ_FIRST(mq)) != NULL) {
-		TAILQ_REMOVE(mq, mi, entry);
-		free(mi);
-	}
+	va_start(ap, fmt);
+	mi = menu_new(&menuq->arena, ctx, fmt, ap);
+	va_end(ap);
+
+	TAILQ_INSERT_TAIL(resultq, mi, resultentry);
+}
+
+void
+menuq_clear(struct menu_q *mq)
+{
+	menu_arena_free(mq->arena);
+	menuq_init(mq);
 }
@@ -24,15 +24,387 @@
 #include <err.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "calmwm.h"
 
-static void	mousefunc_sweep_calc(struct client_ctx *, int, int, int, int);
-static void	mousefunc_sweep_draw(struct client_ctx *);
+#define PACE_DEFAULT_REFRESH	60000	/* mHz */
+
+/*
+ * Moving and resizing update the window at most once a frame of the
+ * output the window is on.  Whatever motion arrived in the meantime is
+ * folded into the latest, and how long it took from reading the first of
+ * those to the server having the window where it belongs is kept, for the
+ * log.
+ */
+struct pace {
+	long long	 frame;		/* us */
+	long long	 next;		/* no update before this */
+	long long	 first;		/* oldest unhandled motion read at */
+	unsigned int	 nmotion;	/* motion events seen */
+	unsigned int	 nframes;	/* window updates */
+	long long	 lat_total;
+	long long	 lat_max;
+};
+
+/*
+ * Where a drag gets the pointer from: XInput2 device events when the
+ * server has them, which carry sub-pixel positions, or else core events.
+ * The times on the events say how often the device reports.
+ */
+struct drag {
+	int		 xi2;
+	int		 deviceid;
+	unsigned int	 nev;
+	Time		 t0, t1;	/* first and latest event times */
+};
+
+struct drag_ev {
+	int		 type;		/* MotionNotify, ButtonPress or -Release */
+	double		 x, y;		/* root */
+};
+
+struct drag_match {
+	struct drag	*d;
+	int		 drain;		/* only motion, ahead of buttons */
+	int		 stop;
+};
+
+/*
+ * In outline mode, four thin override-redirect windows frame where the
+ * client will go, and the client itself is only configured at the end.
+ */
+struct outline {
+	Window		 win[4];
+};
+
+/*
+ * What the geometry overlay shows, so it is only redrawn when that
+ * changes, and the advance of each character it has shown in the font it
+ * was shown in: the string is digits and a few others, so measuring
+ * comes down to adding those up.
+ */
+static struct {
+	XftFont		*font;
+	short		 adv[128];	/* 0 until measured */
+	char		 s[32];
+	int		 x, y, w;
+} overlay;
+
+static long long	mousefunc_usec(void);
+static int		mousefunc_drag_grab(struct drag *, Window, Cursor);
+static void		mousefunc_drag_ungrab(struct drag *);
+static Bool		mousefunc_drag_pred(Display *, XEvent *, XPointer);
+static int		mousefunc_drag_convert(struct drag *, XEvent *,
+			    struct drag_ev *);
+static void		mousefunc_drag_next(struct drag *, struct drag_ev *);
+static unsigned int	mousefunc_drag_latest(struct drag *, struct drag_ev *);
+static void		mousefunc_pace_init(struct pace *, struct screen_ctx *);
+static void		mousefunc_pace_wait(struct pace *, struct drag *,
+			    struct drag_ev *);
+static void		mousefunc_pace_done(struct pace *);
+static void		mousefunc_pace_log(struct pace *, struct drag *,
+			    const char *);
+static void		mousefunc_outline_init(struct outline *,
+			    struct client_ctx *);
+static void		mousefunc_outline_draw(struct outline *,
+			    struct client_ctx *);
+static void		mousefunc_outline_free(struct outline *);
+static int		mousefunc_overlay_width(XftFont *, const char *);
+static void		mousefunc_overlay_draw(struct screen_ctx *,
+			    struct client_ctx *);
+static void		mousefunc_overlay_hide(struct screen_ctx *);
+static void		mousefunc_sweep_calc(struct client_ctx *, int, int, int,
+			    int);
+
+static long long
+mousefunc_usec(void)
+{
+	struct timespec	 ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static void
+mousefunc_pace_init(struct pace *p, struct screen_ctx *sc)
+{
+	unsigned int	 refresh;
+
+	if ((refresh = screen_refresh(sc)) == 0)
+		refresh = PACE_DEFAULT_REFRESH;
+
+	memset(p, 0, sizeof(*p));
+	p->frame = 1000000000LL / refresh;
+	log_debug("%s: %s: %u.%03u Hz, %lld us a frame", __func__, sc->name,
+	    refresh / 1000, refresh % 1000, p->frame);
+}
+
+static int
+mousefunc_drag_grab(struct drag *d, Window win, Cursor cursor)
+{
+	XIEventMask	 mask;
+	unsigned char	 bits[XIMaskLen(XI_LASTEVENT)];
+
+	memset(d, 0, sizeof(*d));
+
+	if (HasXI2 && XIGetClientPointer(X_Dpy, None, &d->deviceid)) {
+		memset(bits, 0, sizeof(bits));
+		XISetMask(bits, XI_Motion);
+		XISetMask(bits, XI_ButtonPress);
+		XISetMask(bits, XI_ButtonRelease);
+		mask.deviceid = d->deviceid;
+		mask.mask_len = sizeof(bits);
+		mask.mask = bits;
+		if (XIGrabDevice(X_Dpy, d->deviceid, win, CurrentTime, cursor,
+		    XIGrabModeAsync, XIGrabModeAsync, False, &mask) ==
+		    GrabSuccess) {
+			d->xi2 = 1;
+			return(0);
+		}
+		log_debug("%s: XIGrabDevice failed, using core events",
+		    __func__);
+	}
+
+	/*
+	 * The button press's grab is already there, so only change it.  It
+	 * froze the keyboard, which must be let go for the drag.
+	 */
+	if (xev_button() != NULL && xu_ptr_regrab(MOUSEMASK, cursor) == 0) {
+		XAllowEvents(X_Dpy, AsyncKeyboard, CurrentTime);
+		return(0);
+	}
+	return(xu_ptr_grab(win, MOUSEMASK, cursor));
+}
+
+static void
+mousefunc_drag_ungrab(struct drag *d)
+{
+	if (d->xi2)
+		XIUngrabDevice(X_Dpy, d->deviceid, CurrentTime);
+	else
+		xu_ptr_ungrab();
+}
+
+/*
+ * The drag's motion and button events, the presses only to be ignored;
+ * when draining, only motion queued ahead of any button event, since
+ * motion after a release belongs to whatever comes next.
+ */
+static Bool
+mousefunc_drag_pred(Display *dpy, XEvent *ev, XPointer arg)
+{
+	struct drag_match	*m = (struct drag_match *)arg;
+	int			 type;
+
+	if (m->stop)
+		return(False);
+
+	if (m->d->xi2) {
+		if (ev->type != GenericEvent ||
+		    ev->xcookie.extension != Xi_opcode)
+			return(False);
+		switch (ev->xcookie.evtype) {
+		case XI_Motion:
+			type = MotionNotify;
+			break;
+		case XI_ButtonPress:
+			type = ButtonPress;
+			break;
+		case XI_ButtonRelease:
+			type = ButtonRelease;
+			break;
+		default:
+			return(False);
+		}
+	} else
+		type = ev->type;
+
+	switch (type) {
+	case MotionNotify:
+		return(True);
+	case ButtonPress:
+	case ButtonRelease:
+		if (m->drain) {
+			m->stop = 1;
+			return(False);
+		}
+		return(True);
+	}
+	return(False);
+}
+
+static int
+mousefunc_drag_convert(struct drag *d, XEvent *ev, struct drag_ev *de)
+{
+	XIDeviceEvent	*xe;
+	Time		 t;
+
+	if (d->xi2) {
+		if (!XGetEventData(X_Dpy, &ev->xcookie))
+			return(0);
+		xe = ev->xcookie.data;
+		switch (xe->evtype) {
+		case XI_Motion:
+			de->type = MotionNotify;
+			break;
+		case XI_ButtonPress:
+			de->type = ButtonPress;
+			break;
+		default:
+			de->type = ButtonRelease;
+			break;
+		}
+		de->x = xe->root_x;
+		de->y = xe->root_y;
+		t = xe->time;
+		XFreeEventData(X_Dpy, &ev->xcookie);
+	} else if (ev->type == MotionNotify) {
+		de->type = MotionNotify;
+		de->x = ev->xmotion.x_root;
+		de->y = ev->xmotion.y_root;
+		t = ev->xmotion.time;
+	} else {
+		de->type = ev->type;
+		de->x = ev->xbutton.x_root;
+		de->y = ev->xbutton.y_root;
+		t = ev->xbutton.time;
+	}
+
+	if (d->nev++ == 0)
+		d->t0 = t;
+	d->t1 = t;
+
+	return(1);
+}
+
+static void
+mousefunc_drag_next(struct drag *d, struct drag_ev *de)
+{
+	struct drag_match	 m = { d, 0, 0 };
+	XEvent			 ev;
+
+	do {
+		XIfEvent(X_Dpy, &ev, mousefunc_drag_pred, (XPointer)&m);
+	} while (!mousefunc_drag_convert(d, &ev, de));
+}
+
+/* Swap in the latest motion already queued, and say how many there were. */
+static unsigned int
+mousefunc_drag_latest(struct drag *d, struct drag_ev *de)
+{
+	struct drag_match	 m = { d, 1, 0 };
+	XEvent			 ev;
+	unsigned int		 n = 0;
+
+	while (XCheckIfEvent(X_Dpy, &ev, mousefunc_drag_pred, (XPointer)&m)) {
+		if (mousefunc_drag_convert(d, &ev, de))
+			n++;
+	}
+	return(n);
+}
+
+/*
+ * Given a motion event, wait for the next frame and then swap in the
+ * latest motion queued since.
+ */
+static void
+mousefunc_pace_wait(struct pace *p, struct drag *d, struct drag_ev *de)
+{
+	struct timespec	 ts;
+	long long	 now;
+
+	now = mousefunc_usec();
+	if (p->first == 0)
+		p->first = now;
+	p->nmotion++;
+	if (now < p->next) {
+		ts.tv_sec = (p->next - now) / 1000000;
+		ts.tv_nsec = ((p->next - now) % 1000000) * 1000;
+		(void)nanosleep(&ts, NULL);
+	}
+
+	p->nmotion += mousefunc_drag_latest(d, de);
+}
+
+/* The window has been updated for this frame. */
+static void
+mousefunc_pace_done(struct pace *p)
+{
+	long long	 now, lat;
+
+	/* Also keeps us from getting ahead of the server. */
+	XSync(X_Dpy, False);
+
+	now = mousefunc_usec();
+	lat = now - p->first;
+	p->lat_total += lat;
+	if (lat > p->lat_max)
+		p->lat_max = lat;
+	p->nframes++;
+	p->next = now + p->frame;
+	p->first = 0;
+}
+
+static void
+mousefunc_pace_log(struct pace *p, struct drag *d, const char *func)
+{
+	if (p->nframes == 0)
+		return;
+	log_debug("%s: %s: %u motion events in %u frames, latency %lld us "
+	    "average, %lld us worst", func, d->xi2 ? "xi2" : "core",
+	    p->nmotion, p->nframes, p->lat_total / p->nframes, p->lat_max);
+	if (d->nev > 1)
+		log_debug("%s: an event every %lu us from the device", func,
+		    (unsigned long)(d->t1 - d->t0) * 1000 / (d->nev - 1));
+}
+
+static void
+mousefunc_outline_init(struct outline *o, struct client_ctx *cc)
+{
+	struct config_group	*cgrp = cc->group->config_group;
+	XSetWindowAttributes	 attr;
+	unsigned int		 i;
+
+	attr.override_redirect = True;
+	attr.background_pixel = cgrp->xftcolor[CWM_COLOR_BORDER_ACTIVE].pixel;
+	for (i = 0; i < nitems(o->win); i++)
+		o->win[i] = XCreateWindow(X_Dpy, cc->sc->rootwin, 0, 0, 1, 1,
+		    0, CopyFromParent, InputOutput, CopyFromParent,
+		    CWOverrideRedirect | CWBackPixel, &attr);
+
+	mousefunc_outline_draw(o, cc);
+	for (i = 0; i < nitems(o->win); i++)
+		XMapRaised(X_Dpy, o->win[i]);
+}
+
+/* Frame cc->geom, borders and all. */
+static void
+mousefunc_outline_draw(struct outline *o, struct client_ctx *cc)
+{
+	int	 x = cc->geom.x, y = cc->geom.y, t = MAX(cc->bwidth, 1);
+	int	 w = cc->geom.w + cc->bwidth * 2, h = cc->geom.h + cc->bwidth * 2;
+	int	 side = MAX(h - t * 2, 1);
+
+	XMoveResizeWindow(X_Dpy, o->win[0], x, y, w, t);
+	XMoveResizeWindow(X_Dpy, o->win[1], x, y + h - t, w, t);
+	XMoveResizeWindow(X_Dpy, o->win[2], x, y + t, t, side);
+	XMoveResizeWindow(X_Dpy, o->win[3], x + w - t, y + t, t, side);
+}
+
+static void
+mousefunc_outline_free(struct outline *o)
+{
+	unsigned int	 i;
+
+	for (i = 0; i < nitems(o->win); i++)
+		XDestroyWindow(X_Dpy, o->win[i]);
+}
 
 static void
 mousefunc_sweep_calc(struct client_ctx *cc, int x, int y, int mx, int my)
@@ -46,32 +418,89 @@ mousefunc_sweep_calc(struct client_ctx *cc, int x, int y, int mx, int my)
 	cc->geom.y = y <= my ? y : y - cc->geom.h;
 }
 
+static int
+mousefunc_overlay_width(XftFont *font, const char *str)
+{
+	const unsigned char	*p;
+	int			 w = 0;
+
+	if (font != overlay.font) {
+		memset(overlay.adv, 0, sizeof(overlay.adv));
+		overlay.font = font;
+	}
+	for (p = (const unsigned char *)str; *p != '\0'; p++) {
+		if (*p >= nitems(overlay.adv))
+			return(xu_xft_width(font, str, strlen(str)));
+		if (overlay.adv[*p] == 0)
+			overlay.adv[*p] = xu_xft_width(font, (const char *)p, 1);
+		w += overlay.adv[*p];
+	}
+	return(w);
+}
+
+/*
+ * Show cc's size, in its own increments, and position, on sc: the screen
+ * the drag started on, whichever cc has moved to since.
+ */
 static void
-mousefunc_sweep_draw(struct client_ctx *cc)
+mousefunc_overlay_draw(struct screen_ctx *sc, struct client_ctx *cc)
 {
-	struct screen_ctx	*sc = cc->sc;
 	struct config_group	*cgrp = sc->group_current->config_group;
-	char			 s[14]; /* fits " nnnn x nnnn \0" */
-
-	(void)snprintf(s, sizeof(s), " %4d x %-4d ", cc->dim.w, cc->dim.h);
+	char			 s[sizeof(overlay.s)];
+	int			 x, y, w, h;
+
+	(void)snprintf(s, sizeof(s), " %d x %d %+d%+d ",
+	    (cc->geom.w - cc->hint.basew) / cc->hint.incw,
+	    (cc->geom.h - cc->hint.baseh) / cc->hint.inch,
+	    cc->geom.x, cc->geom.y);
+
+	w = mousefunc_overlay_width(cgrp->xftfont, s);
+	h = cgrp->xftfont->height;
+
+	/* In the middle of the window. */
+	x = cc->geom.x + (cc->geom.w + cc->bwidth * 2 - w) / 2 - cgrp->bwidth;
+	y = cc->geom.y + (cc->geom.h + cc->bwidth * 2 - h) / 2 - cgrp->bwidth;
+
+	if (overlay.s[0] == '\0') {
+		XMoveResizeWindow(X_Dpy, sc->geomwin, x, y, w, h);
+		XMapRaised(X_Dpy, sc->geomwin);
+	} else if (w != overlay.w)
+		XMoveResizeWindow(X_Dpy, sc->geomwin, x, y, w, h);
+	else if (x != overlay.x || y != overlay.y)
+		XMoveWindow(X_Dpy, sc->geomwin, x, y);
+	overlay.x = x;
+	overlay.y = y;
+	overlay.w = w;
+
+	if (strcmp(s, overlay.s) == 0)
+		return;
+	(void)strlcpy(overlay.s, s, sizeof(overlay.s));
 
-	XReparentWindow(X_Dpy, sc->menuwin, cc->win, 0, 0);
-	XMoveResizeWindow(X_Dpy, sc->menuwin, 0, 0,
-	    xu_xft_width(cgrp->xftfont, s, strlen(s)), cgrp->xftfont->height);
-	XMapWindow(X_Dpy, sc->menuwin);
-	XClearWindow(X_Dpy, sc->menuwin);
+	XClearWindow(X_Dpy, sc->geomwin);
+	XftDrawStringUtf8(sc->geomdraw, &cgrp->xftcolor[CWM_COLOR_MENU_FONT],
+	    cgrp->xftfont, 0, cgrp->xftfont->ascent, (const FcChar8 *)s,
+	    strlen(s));
+}
 
-	xu_xft_draw(sc, s, CWM_COLOR_MENU_FONT, 0, cgrp->xftfont->ascent + 1);
+static void
+mousefunc_overlay_hide(struct screen_ctx *sc)
+{
+	XUnmapWindow(X_Dpy, sc->geomwin);
+	overlay.s[0] = '\0';
 }
 
 void
 mousefunc_client_resize(struct client_ctx *cc, union arg *arg)
 {
-	XEvent			 ev;
-	Time			 ltime = 0;
+	struct drag_ev		 ev;
+	struct drag		 drag;
 	struct screen_ctx	*sc = cc->sc;
 	struct config_screen	*cscr = sc->config_screen;
-	int			 x = cc->geom.x, y = cc->geom.y;
+	struct geom		 g;
+	struct pace		 pace;
+	struct outline		 outline;
+	int			 x = cc->geom.x, y = cc->geom.y, reset = 1;
+	int			 outlined = cscr->outline & CWM_OUTLINE_RESIZE;
 
 	if (cc->flags & CLIENT_FREEZE)
 		return;
@@ -79,32 +508,46 @@ mousefunc_client_resize(struct client_ctx *cc, union arg *arg)
 	client_raise(cc);
 	client_ptrsave(cc);
 
-	if (xu_ptr_grab(cc->win, MOUSEMASK, cscr->cursor[CF_RESIZE]) < 0)
+	if (mousefunc_drag_grab(&drag, cc->win, cscr->cursor[CF_RESIZE]) < 0)
 		return;
 
 	xu_ptr_setpos(cc->win, cc->geom.w, cc->geom.h);
-	mousefunc_sweep_draw(cc);
+	mousefunc_pace_init(&pace, sc);
+	if (outlined)
+		mousefunc_outline_init(&outline, cc);
+	mousefunc_overlay_draw(sc, cc);
 
 	for (;;) {
-		XMaskEvent(X_Dpy, MOUSEMASK, &ev);
+		mousefunc_drag_next(&drag, &ev);
 
 		switch (ev.type) {
 		case MotionNotify:
-			/* not more than 60 times / second */
-			if ((ev.xmotion.time - ltime) <= (1000 / 60))
-				continue;
-			ltime = ev.xmotion.time;
+			mousefunc_pace_wait(&pace, &drag, &ev);
 
+			g = cc->geom;
 			mousefunc_sweep_calc(cc, x, y,
-			    ev.xmotion.x_root, ev.xmotion.y_root);
-			client_resize(cc, 1);
-			mousefunc_sweep_draw(cc);
+			    (int)lround(ev.x), (int)lround(ev.y));
+			if (memcmp(&g, &cc->geom, sizeof(g)) == 0) {
+				/* Size hints may round it to no change. */
+				pace.first = 0;
+				break;
+			}
+			if (outlined)
+				mousefunc_outline_draw(&outline, cc);
+			else {
+				client_resize(cc, reset);
+				reset = 0;
+			}
+			mousefunc_overlay_draw(sc, cc);
+			mousefunc_pace_done(&pace);
 			break;
 		case ButtonRelease:
+			mousefunc_pace_log(&pace, &drag, __func__);
+			if (outlined)
+				mousefunc_outline_free(&outline);
 			client_resize(cc, 1);
-			XUnmapWindow(X_Dpy, sc->menuwin);
-			XReparentWindow(X_Dpy, sc->menuwin, sc->rootwin, 0, 0);
-			xu_ptr_ungrab();
+			mousefunc_overlay_hide(sc);
+			mousefunc_drag_ungrab(&drag);
 
 			/* Make sure the pointer stays within the window. */
 			if (cc->ptr.x > cc->geom.w)
@@ -123,35 +566,47 @@ mousefunc_client_resize(struct client_ctx *cc, union arg *arg)
 void
 mousefunc_client_move(struct client_ctx *cc, union arg *arg)
 {
-	XEvent			 ev;
-	Time			 ltime = 0;
+	struct drag_ev		 ev;
+	struct drag		 drag;
+	const XButtonEvent	*bev;
 	struct screen_ctx	*sc = cc->sc;
 	struct config_screen	*cscr = sc->config_screen;
 	struct geom		 xine;
-	int			 px, py;
+	struct pace		 pace;
+	struct outline		 outline;
+	int			 px, py, ox, oy;
+	int			 outlined = cscr->outline & CWM_OUTLINE_MOVE;
 
 	client_raise(cc);
 
 	if (cc->flags & CLIENT_FREEZE)
 		return;
 
-	if (xu_ptr_grab(cc->win, MOUSEMASK, cscr->cursor[CF_MOVE]) < 0)
+	if (mousefunc_drag_grab(&drag, cc->win, cscr->cursor[CF_MOVE]) < 0)
 		return;
 
-	xu_ptr_getpos(cc->win, &px, &py);
+	/* Where in the window it was grabbed, from the press if we can. */
+	if ((bev = xev_button()) != NULL) {
+		px = bev->x_root - cc->geom.x - cc->bwidth;
+		py = bev->y_root - cc->geom.y - cc->bwidth;
+	} else
+		xu_ptr_getpos(cc->win, &px, &py);
+	mousefunc_pace_init(&pace, sc);
+	if (outlined)
+		mousefunc_outline_init(&outline, cc);
+	mousefunc_overlay_draw(sc, cc);
 
 	for (;;) {
-		XMaskEvent(X_Dpy, MOUSEMASK, &ev);
+		mousefunc_drag_next(&drag, &ev);
 
 		switch (ev.type) {
 		case MotionNotify:
-			/* not more than 60 times / second */
-			if ((ev.xmotion.time - ltime) <= (1000 / 60))
-				continue;
-			ltime = ev.xmotion.time;
+			mousefunc_pace_wait(&pace, &drag, &ev);
 
-			cc->geom.x = ev.xmotion.x_root - px - cc->bwidth;
-			cc->geom.y = ev.xmotion.y_root - py - cc->bwidth;
+			ox = cc->geom.x;
+			oy = cc->geom.y;
+			cc->geom.x = (int)lround(ev.x) - px - cc->bwidth;
+			cc->geom.y = (int)lround(ev.y) - py - cc->bwidth;
 
 			xine = screen_find_xinerama(cc->geom.x, cc->geom.y,
 			    CWM_GAP);
@@ -161,14 +616,28 @@ mousefunc_client_move(struct client_ctx *cc, union arg *arg)
 			cc->geom.y += client_snapcalc(cc->geom.y,
 			    cc->geom.y + cc->geom.h + (cc->bwidth * 2),
 			    xine.y, xine.y + xine.h, cscr->snapdist);
-
-			client_move(cc);
+			if (cc->geom.x == ox && cc->geom.y == oy) {
+				/* Held by snapping. */
+				pace.first = 0;
+				break;
+			}
+
+			if (outlined)
+				mousefunc_outline_draw(&outline, cc);
+			else
+				client_move(cc);
+			mousefunc_overlay_draw(sc, cc);
+			mousefunc_pace_done(&pace);
 			break;
 		case ButtonRelease:
+			mousefunc_pace_log(&pace, &drag, __func__);
+			if (outlined)
+				mousefunc_outline_free(&outline);
+			mousefunc_overlay_hide(sc);
 			client_move(cc);
 			client_log_debug(__func__, cc);
 			client_record_geom(cc);
-			xu_ptr_ungrab();
+			mousefunc_drag_ungrab(&drag);
 			return;
 		}
 	}
@@ -183,7 +652,7 @@ mousefunc_menu_group(struct client_ctx *cc, union arg *arg)
 	struct menu		*mi;
 	struct menu_q		 menuq;
 
-	TAILQ_INIT(&menuq);
+	menuq_init(&menuq);
 	TAILQ_FOREACH(gc, &sc->groupq, entry) {
 		if (group_holds_only_sticky(gc))
 			continue;
@@ -208,10 +677,13 @@ mousefunc_menu_unhide(struct client_ctx *cc, union arg *arg)
 	struct client_ctx	*old_cc;
 	struct menu		*mi;
 	struct menu_q		 menuq;
+	Window			 old_win;
 
+	/* It may go while the menu is up; find it again after. */
 	old_cc = client_current();
+	old_win = (old_cc != NULL) ? old_cc->win : None;
 
-	TAILQ_INIT(&menuq);
+	menuq_init(&menuq);
 	TAILQ_FOREACH(cc, &sc->clientq, entry) {
 		if (cc->flags & CLIENT_HIDDEN) {
 			menuq_add(&menuq, cc, NULL);
@@ -222,7 +694,7 @@ mousefunc_menu_unhide(struct client_ctx *cc, union arg *arg)
 	    NULL, search_print_client)) != NULL) {
 		cc = (struct client_ctx *)mi->ctx;
 		client_unhide(cc);
-		if (old_cc != NULL)
+		if (old_win != None && (old_cc = client_find(old_win)) != NULL)
 			client_ptrsave(old_cc);
 		client_ptrwarp(cc);
 	}
@@ -238,7 +710,7 @@ mousefunc_menu_cmd(struct client_ctx *cc, union arg *arg)
 	struct menu		*mi;
 	struct menu_q		 menuq;
 
-	TAILQ_INIT(&menuq);
+	menuq_init(&menuq);
 	TAILQ_FOREACH(cmd, &cmdq, entry)
 		menuq_add(&menuq, cmd, "%s", cmd->name);
 
@@ -23,185 +23,234 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include "calmwm.h"
 
 static struct binding	*rule_make_binding(const char *);
+static void		 rule_resolve(struct client_ctx *);
+
+static const char	*rule_hook_names[RULE_NHOOKS] = {
+	"on-map",
+	"on-focus",
+	"on-close",
+	"on-net-active",
+};
+
+/*
+ * Bumped whenever ruleq changes, so clients know their resolved hooks are
+ * stale.  Starts at 1 so that a fresh client always resolves.
+ */
+static unsigned int	 rule_gen = 1;
 
 static struct binding *
 rule_make_binding(const char *action)
 {
-	struct binding		*b = NULL;
-	const struct name_func	*nf;
+	struct binding		*b;
 
-	for (nf = name_to_func; nf->tag != NULL; nf++) {
-		if (strcmp(nf->tag, action) != 0)
-			continue;
-
-		b = xcalloc(1, sizeof(*b));
-		b->callback = nf->handler;
-		b->flags = nf->flags;
-		b->argument = nf->argument;
+	b = xcalloc(1, sizeof(*b));
+	if (conf_action_parse(action, b) != 1) {
+		free(b);
+		return (NULL);
 	}
 
 	return (b);
 }
 
-bool
-rule_validate_title(const char *rule_title)
+int
+rule_hook_lookup(const char *rule_title)
 {
-	const char	*rule_names[] = {
-		"on-map",
-		"on-focus",
-		"on-close",
-		"on-net-active",
-		NULL,
-	};
-
-	const char	**rt;
-
-	for (rt = rule_names; *rt != NULL; rt++) {
-		if (strcmp(*rt, rule_title) == 0)
-			return (true);
+	int	 i;
+
+	for (i = 0; i < RULE_NHOOKS; i++) {
+		if (strcmp(rule_hook_names[i], rule_title) == 0)
+			return (i);
 	}
 
-	return (false);
+	return (-1);
+}
+
+bool
+rule_validate_title(const char *rule_title)
+{
+	return (rule_hook_lookup(rule_title) != -1);
 }
 
 void
-rule_config(const char *class, const char *rname, const char *action)
+rule_config(struct match *m, const char *rname, const char *action)
 {
-	struct rule		*rule = NULL, *r_find = NULL;
-	struct rule_item	*ritem;
+	struct binding		*b;
 
 	if (action == NULL)
 		return;
 
-	if (!TAILQ_EMPTY(&ruleq)) {
-		TAILQ_FOREACH(r_find, &ruleq, entry) {
-			if (strcmp(r_find->rule_name, rname) == 0 &&
-			    strcmp(r_find->client_class, class) == 0) {
-				rule = r_find;
-				break;
-			}
-		}
-
-		if (rule == NULL) {
-			log_debug("%s: {r: %s, c: %s, a: %s} is new",
-			    __func__, rname, class, action);
+	if ((b = rule_make_binding(action)) == NULL) {
+		log_debug("%s: action '%s' doesn't exist", __func__, action);
+		return;
+	}
 
-			goto make_rule;
-		}
+	rule_add(m, rname, action, b);
+}
 
-		ritem = xcalloc(1, sizeof(*ritem));
-		ritem->name = xstrdup(action);
-		if ((ritem->b = rule_make_binding(action)) == NULL) {
-			log_debug("%s: action '%s' doesn't exist",
-					__func__, action);
+void
+rule_add(struct match *m, const char *rname, const char *action,
+    struct binding *b)
+{
+	struct rule		*rule = NULL, *r_find;
+	struct rule_item	*ritem;
 
-			free((char *)ritem->name);
-			free(ritem);
-			return;
+	TAILQ_FOREACH(r_find, &ruleq, entry) {
+		if (r_find->match == m &&
+		    strcmp(r_find->rule_name, rname) == 0) {
+			rule = r_find;
+			break;
 		}
-		log_debug("%s: adding rule: {r: %s, c: %s, a: %s}",
-				__func__, rname, class, action);
-		rule->ri_size++;
-		TAILQ_INSERT_TAIL(&rule->rule_item, ritem, entry);
-
-		return;
 	}
 
-make_rule:
-	rule = xmalloc(sizeof(*rule));
-	TAILQ_INIT(&rule->rule_item);
+	if (rule == NULL) {
+		log_debug("%s: {r: %s, c: %s, a: %s} is new",
+		    __func__, rname, m->desc, action);
 
-	rule->rule_name = xstrdup(rname);
-	rule->client_class = xstrdup(class);
-	rule->ri_size = 0;
+		rule = xmalloc(sizeof(*rule));
+		TAILQ_INIT(&rule->rule_item);
+
+		rule->rule_name = xstrdup(rname);
+		rule->match = m;
+		rule->hook = rule_hook_lookup(rname);
+		rule->ri_size = 0;
+		TAILQ_INSERT_TAIL(&ruleq, rule, entry);
+	}
 
 	ritem = xcalloc(1, sizeof(*ritem));
 	ritem->name = xstrdup(action);
-	if ((ritem->b = rule_make_binding(action)) == NULL) {
-		log_debug("%s: action '%s' doesn't exist", __func__,
-				action);
+	ritem->b = b;
 
-		free((char *)ritem->name);
-		free(ritem);
-
-		return;
-	}
-	TAILQ_INSERT_TAIL(&ruleq, rule, entry);
 	log_debug("%s: adding rule: {r: %s, c: %s, a: %s}",
-			__func__, rname, class, action);
+	    __func__, rname, m->desc, action);
 
 	rule->ri_size++;
 	TAILQ_INSERT_TAIL(&rule->rule_item, ritem, entry);
+	rule_gen++;
 }
 
 void
-rule_apply(struct client_ctx *cc, const char *rule_name)
+rule_clear(void)
+{
+	struct rule		*rule, *rule_tmp;
+	struct rule_item	*ri, *ri_tmp;
+
+	TAILQ_FOREACH_SAFE(rule, &ruleq, entry, rule_tmp) {
+		TAILQ_FOREACH_SAFE(ri, &rule->rule_item, entry, ri_tmp) {
+			TAILQ_REMOVE(&rule->rule_item, ri, entry);
+			free((char *)ri->name);
+			free(ri->b);
+			free(ri);
+		}
+		TAILQ_REMOVE(&ruleq, rule, entry);
+		free((char *)rule->rule_name);
+		free(rule);
+	}
+	rule_gen++;
+}
+
+/*
+ * Work out, once, which rule items apply to this client for each hook, so
+ * that firing a hook is just a walk over an array.
+ */
+static void
+rule_resolve(struct client_ctx *cc)
 {
-	char			*class = cc->ch.res_class;
 	struct rule		*rule;
 	struct rule_item	*rule_i;
+	struct rule_hook	*rh;
 
-	if (class == NULL)
-		return;
+	rule_client_clear(cc);
+	cc->rule_gen = rule_gen;
 
 	TAILQ_FOREACH(rule, &ruleq, entry) {
-		if (strcmp(rule->rule_name, rule_name) != 0)
-			continue;
-		if (strcmp(class, rule->client_class) != 0)
+		if (rule->hook == -1 || !match_client_has(cc, rule->match))
 			continue;
 
 		log_debug("%s: for client '%s', rule '%s' applies",
-		    __func__, class, rule->rule_name);
+		    __func__, rule->match->desc, rule->rule_name);
 
-		rule->cc = cc;
+		rh = &cc->hooks[rule->hook];
+		rh->items = xreallocarray(rh->items, rh->n + rule->ri_size,
+		    sizeof(*rh->items));
+		TAILQ_FOREACH(rule_i, &rule->rule_item, entry)
+			rh->items[rh->n++] = rule_i;
+	}
+}
 
-		/* Otherwise, we found the rule we need. */
-		TAILQ_FOREACH(rule_i, &rule->rule_item, entry) {
-			/* Go through each binding and apply the rules in
-			 * order.
-			 */
-			log_debug("%s:\tapplying '%s' cmd", __func__,
-			     rule_i->name);
+/* Forget the client's resolved hooks, e.g. when its WM_CLASS changes. */
+void
+rule_client_clear(struct client_ctx *cc)
+{
+	int	 i;
 
-			(*rule_i->b->callback)(cc, &rule_i->b->argument);
-		}
+	for (i = 0; i < RULE_NHOOKS; i++) {
+		free(cc->hooks[i].items);
+		cc->hooks[i].items = NULL;
+		cc->hooks[i].n = 0;
 	}
+	cc->rule_gen = 0;
 }
 
-const char *
-rule_print_rule(struct client_ctx *cc)
+void
+rule_apply(struct client_ctx *cc, int hook)
 {
-	struct rule		*r_find = NULL, *rule = NULL;
+	struct rule_hook	*rh;
 	struct rule_item	*rule_i;
-	char			*rule_str;
-	char			*ra, *rule_actions;
+	size_t			 i;
 
-	TAILQ_FOREACH(r_find, &ruleq, entry) {
-		if (cc == r_find->cc) {
-			rule = r_find;
-			break;
-		}
-	}
+	if (cc == NULL)
+		return;
 
-	if (rule == NULL) {
-		xasprintf(&rule_str, "%s", "none"); 
-		return (rule_str);
+	if (cc->rule_gen != rule_gen)
+		rule_resolve(cc);
+
+	rh = &cc->hooks[hook];
+	for (i = 0; i < rh->n; i++) {
+		/* Apply the rules in the order they were configured. */
+		rule_i = rh->items[i];
+		log_debug("%s:\tapplying '%s' cmd for '%s'", __func__,
+		    rule_i->name, rule_hook_names[hook]);
+
+		(*rule_i->b->callback)(cc, &rule_i->b->argument);
 	}
+}
 
-	ra = rule_actions = malloc(rule->ri_size + 1);
-	TAILQ_FOREACH(rule_i, &rule->rule_item, entry) {
-		ra += sprintf(ra, "%s,", rule_i->name);
+const char *
+rule_print_rule(struct client_ctx *cc)
+{
+	struct rule_hook	*rh;
+	char			*rule_str = NULL, *tmp;
+	size_t			 j;
+	int			 i;
+
+	if (cc->rule_gen != rule_gen)
+		rule_resolve(cc);
+
+	for (i = 0; i < RULE_NHOOKS; i++) {
+		rh = &cc->hooks[i];
+		if (rh->n == 0)
+			continue;
+
+		tmp = rule_str;
+		xasprintf(&rule_str, "%s%s%s: {", tmp ? tmp : "",
+		    tmp ? " " : "", rule_hook_names[i]);
+		free(tmp);
+
+		for (j = 0; j < rh->n; j++) {
+			tmp = rule_str;
+			xasprintf(&rule_str, "%s%s%s", tmp,
+			    rh->items[j]->name, j + 1 < rh->n ? "," : "}");
+			free(tmp);
+		}
 	}
-	ra[-1] = '\0';
 
-	xasprintf(&rule_str, "[pointer: %p]:\n\t"
-	    "\tname: %s\n\t"
-	    "\tactions: {%s}",
-	    rule, rule->rule_name, rule_actions);
+	if (rule_str == NULL)
+		xasprintf(&rule_str, "%s", "none");
 
 	return (rule_str);
 }
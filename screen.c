@@ -69,6 +69,7 @@ screen_maybe_init_randr(void)
 		log_debug("No RandR present; using single screen...");
 		goto single_screen;
 	}
+	HasRandr = 1;
 
 	screen_res = XRRGetScreenResources(X_Dpy, DefaultRootWindow(X_Dpy));
 
@@ -224,7 +225,9 @@ screen_init_contents(void)
 		sc->hideall = 0;
 		sc->menuwin = 0;
 		sc->xftdraw = NULL;
-		sc->config_screen = xmalloc(sizeof(*sc->config_screen));
+		sc->geomwin = None;
+		sc->geomdraw = NULL;
+		sc->config_screen = xcalloc(1, sizeof(*sc->config_screen));
 
 		log_debug("%s: Adding groups...", __func__);
 		for (i = 0; i < CALMWM_NGROUPS; i++)
@@ -327,6 +330,61 @@ screen_find_xinerama(int x, int y, int flags)
 	return(g);
 }
 
+/*
+ * The refresh rate of the mode the output behind sc is in now, in mHz, or
+ * 0 if it can't be found.  Modes change, so this asks every time.
+ */
+unsigned int
+screen_refresh(struct screen_ctx *sc)
+{
+	XRRScreenResources	*res;
+	XRROutputInfo		*oinfo;
+	XRRCrtcInfo		*crtc;
+	XRRModeInfo		*mode;
+	unsigned long		 vtotal;
+	unsigned int		 refresh = 0;
+	int			 i, j;
+
+	if (!HasRandr)
+		return(0);
+	if ((res = XRRGetScreenResourcesCurrent(X_Dpy, sc->rootwin)) == NULL)
+		return(0);
+
+	for (i = 0; i < res->noutput && refresh == 0; i++) {
+		oinfo = XRRGetOutputInfo(X_Dpy, res, res->outputs[i]);
+		if (oinfo == NULL)
+			continue;
+		if (oinfo->crtc == None || strcmp(oinfo->name, sc->name) != 0) {
+			XRRFreeOutputInfo(oinfo);
+			continue;
+		}
+		if ((crtc = XRRGetCrtcInfo(X_Dpy, res, oinfo->crtc)) == NULL) {
+			XRRFreeOutputInfo(oinfo);
+			continue;
+		}
+		for (j = 0; j < res->nmode; j++) {
+			mode = &res->modes[j];
+			if (mode->id != crtc->mode)
+				continue;
+			vtotal = mode->vTotal;
+			if (mode->modeFlags & RR_DoubleScan)
+				vtotal *= 2;
+			if (mode->modeFlags & RR_Interlace)
+				vtotal /= 2;
+			if (mode->hTotal != 0 && vtotal != 0)
+				refresh = (unsigned long long)mode->dotClock *
+				    1000 / ((unsigned long long)mode->hTotal *
+				    vtotal);
+			break;
+		}
+		XRRFreeCrtcInfo(crtc);
+		XRRFreeOutputInfo(oinfo);
+	}
+	XRRFreeScreenResources(res);
+
+	return(refresh);
+}
+
 void
 screen_update_geometry(struct screen_ctx *sc)
 {
@@ -19,10 +19,13 @@
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
-#include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <glob.h>
 #include <limits.h>
@@ -36,11 +39,75 @@
 #define PATH_ANY 	0x0001
 #define PATH_EXEC 	0x0002
 
+/* Fuzzy scoring, after fzf. */
+#define FUZZY_MATCH		16
+#define FUZZY_GAP_START		-3
+#define FUZZY_GAP_EXT		-1
+#define FUZZY_BOUNDARY		8
+#define FUZZY_CAMEL		7
+#define FUZZY_CONSEC		4
+#define FUZZY_PREFIX		8
+#define FUZZY_TOPK		256	/* more rows than any menu shows */
+#define FUZZY_MASKVALID		(1ULL << 63)
+#define FUZZY_HISTORY		4	/* per recent use */
+#define FUZZY_HISTORY_MAX	(2 * FUZZY_MATCH)
+
+struct path_ent {
+	char		*name;
+	int		 isdir;
+	int		 isexec;	/* -1 until asked */
+};
+
+/* The directory being completed, so each keystroke needn't read it. */
+struct path_cache {
+	char		*dir;		/* as typed, up to the last '/' */
+	struct timespec	 mtime;
+	int		 dfd;
+	struct path_ent	*ents;
+	size_t		 nents;
+};
+
+static struct path_cache	 path_cache = { .dfd = -1 };
+
+struct search_sort {
+	struct menu	*mi;
+	int		 tier;
+	float		 boost;		/* from the history */
+	size_t		 idx;
+};
+
+struct fuzzy_result {
+	struct menu	*mi;
+	const char	*key;
+	int		 score;
+	int		 top;
+	size_t		 len;
+	size_t		 idx;
+};
+
 static void	search_match_path(struct menu_q *, struct menu_q *,
 		    char *, int);
 static void	search_match_path_exec(struct menu_q *, struct menu_q *,
 		    char *);
-static int	strsubmatch(char *, char *, int);
+static void	path_cache_load(const char *);
+static int	path_ent_cmp(const void *, const void *);
+static int	strsubmatch(const char *, size_t, const char *, int);
+static void	search_client_rank(struct menu *, const char *, size_t,
+		    struct search_sort **, size_t *, size_t *);
+static int	search_sort_cmp(const void *, const void *);
+static int	search_rank_cmp(const void *, const void *);
+static void	search_sort_add(struct search_sort **, size_t *, size_t *,
+		    struct menu *, int, float);
+static int	fuzzy_history(uint64_t);
+static uint64_t	fuzzy_charmask(const char *);
+static int	fuzzy_score(const char *, size_t, const char *, const char *,
+		    int *);
+static int	fuzzy_better(const struct fuzzy_result *,
+		    const struct fuzzy_result *);
+static void	fuzzy_heap_down(struct fuzzy_result *, size_t, size_t);
+static int	fuzzy_rank_cmp(const void *, const void *);
+static void	fuzzy_rank(struct fuzzy_result *, size_t, struct menu_q *,
+		    int);
 
 /*
  * Match: label, title, class.
@@ -49,81 +116,98 @@ static int	strsubmatch(char *, char *, int);
 void
 search_match_client(struct menu_q *menuq, struct menu_q *resultq, char *search)
 {
-	struct winname	*wn;
-	struct menu	*mi, *tierp[4], *before = NULL;
+	struct search_sort	*v = NULL;
+	struct client_ctx	**cand;
+	struct menu		*mi;
+	char			*fsearch;
+	size_t			 i, flen, ncand, n = 0, nalloc = 0;
 
 	TAILQ_INIT(resultq);
 
-	(void)memset(tierp, 0, sizeof(tierp));
+	fsearch = u_fold(search);
+	flen = strlen(fsearch);
 
 	/*
-	 * In order of rank:
-	 *
-	 *   1. Look through labels.
-	 *   2. Look at title history, from present to past.
-	 *   3. Look at window class name.
+	 * For longer searches, the index says which clients could match, and
+	 * only their window menu entries are looked at.  Where menu.c has
+	 * narrowed menuq to what matched a shorter search, anything left
+	 * out couldn't match this one either.
 	 */
+	if (trigram_candidates(fsearch, flen, &cand, &ncand) == 0) {
+		for (i = 0; i < ncand; i++) {
+			if ((mi = cand[i]->winmenu) != NULL)
+				search_client_rank(mi, fsearch, flen, &v, &n,
+				    &nalloc);
+		}
+		free(cand);
+	} else {
+		TAILQ_FOREACH(mi, menuq, entry)
+			search_client_rank(mi, fsearch, flen, &v, &n, &nalloc);
+	}
+	free(fsearch);
 
-	TAILQ_FOREACH(mi, menuq, entry) {
-		int tier = -1, t;
-		struct client_ctx *cc = mi->ctx;
+	qsort(v, n, sizeof(*v), search_rank_cmp);
+	for (i = 0; i < n; i++)
+		TAILQ_INSERT_TAIL(resultq, v[i].mi, resultentry);
+	free(v);
+}
 
-		/* First, try to match on labels. */
-		if (cc->label != NULL && strsubmatch(search, cc->label, 0)) {
-			cc->matchname = cc->label;
-			tier = 0;
-		}
+/*
+ * Rank one client for search_match_client, in order:
+ *
+ *   1. Look through labels.
+ *   2. Look at title history, from present to past.
+ *   3. Look at window class name.
+ *
+ * Within a tier, the classes used most come first.
+ */
+static void
+search_client_rank(struct menu *mi, const char *fsearch, size_t flen,
+    struct search_sort **v, size_t *n, size_t *nalloc)
+{
+	struct client_ctx	*cc = mi->ctx;
+	struct winname		*wn;
+	int			 tier = -1;
+
+	/* First, try to match on labels. */
+	if (cc->label != NULL && strsubmatch(fsearch, flen, cc->label_fold, 0)) {
+		cc->matchname = cc->label;
+		tier = 0;
+	}
 
-		/* Then, on window names. */
-		if (tier < 0) {
-			TAILQ_FOREACH_REVERSE(wn, &cc->nameq, winname_q, entry)
-				if (strsubmatch(search, wn->name, 0)) {
-					cc->matchname = wn->name;
-					tier = 2;
-					break;
-				}
-		}
+	/* Then, on window names. */
+	if (tier < 0) {
+		TAILQ_FOREACH_REVERSE(wn, &cc->nameq, winname_q, entry)
+			if (strsubmatch(fsearch, flen, wn->fold, 0)) {
+				cc->matchname = wn->name;
+				tier = 2;
+				break;
+			}
+	}
 
-		/* Then if there is a match on the window class name. */
-		if (tier < 0 && strsubmatch(search, cc->ch.res_class, 0)) {
-			cc->matchname = cc->ch.res_class;
-			tier = 3;
-		}
+	/* Then if there is a match on the window class name. */
+	if (tier < 0 && strsubmatch(fsearch, flen, cc->class_fold, 0)) {
+		cc->matchname = cc->ch.res_class;
+		tier = 3;
+	}
 
-		if (tier < 0)
-			continue;
+	if (tier < 0)
+		return;
 
-		/*
-		 * De-rank a client one tier if it's the current
-		 * window.  Furthermore, this is denoted by a "!" when
-		 * printing the window name in the search menu.
-		 */
-		if (cc == client_current() && tier < nitems(tierp) - 1)
-			tier++;
-
-		/* Clients that are hidden get ranked one up. */
-		if ((cc->flags & CLIENT_HIDDEN) && (tier > 0))
-			tier--;
-
-		assert(tier < nitems(tierp));
-
-		/*
-		 * If you have a tierp, insert after it, and make it
-		 * the new tierp.  If you don't have a tierp, find the
-		 * first nonzero tierp above you, insert after it.
-		 * Always make your current tierp the newly inserted
-		 * entry.
-		 */
-		for (t = tier; t >= 0 && ((before = tierp[t]) == NULL); t--)
-			;
-
-		if (before == NULL)
-			TAILQ_INSERT_HEAD(resultq, mi, resultentry);
-		else
-			TAILQ_INSERT_AFTER(resultq, before, mi, resultentry);
+	/*
+	 * De-rank a client one tier if it's the current
+	 * window.  Furthermore, this is denoted by a "!" when
+	 * printing the window name in the search menu.
+	 */
+	if (cc == client_current() && tier < 3)
+		tier++;
 
-		tierp[tier] = mi;
-	}
+	/* Clients that are hidden get ranked one up. */
+	if ((cc->flags & CLIENT_HIDDEN) && (tier > 0))
+		tier--;
+
+	search_sort_add(v, n, nalloc, mi, tier, history_score(
+	    history_key(cc->ch.res_class, cc->ch.res_name)));
 }
 
 void
@@ -131,7 +215,7 @@ search_print_group(struct menu *mi, int i)
 {
 	struct group_ctx	*gc = (struct group_ctx *)mi->ctx;
 
-	(void)snprintf(mi->print, sizeof(mi->print),
+	(void)snprintf(mi->print, MENU_MAXENTRY + 1,
 	    (group_holds_only_hidden(gc)) ? "%d: [%s]" : "%d: %s",
 	    gc->num, gc->name);
 }
@@ -152,17 +236,17 @@ search_print_client(struct menu *mi, int list)
 	if (list)
 		cc->matchname = cc->name;
 
-	(void)snprintf(mi->print, sizeof(mi->print), "%s: (%d) %c[%s] %s",
+	(void)snprintf(mi->print, MENU_MAXENTRY + 1, "%s: (%d) %c[%s] %s",
 	    cc->sc->name, cc->group ? cc->group->num : 0, flag,
 	    cc->label ? cc->label : "", cc->matchname);
 
 	if (!list && cc->matchname != cc->name &&
-	    strlen(mi->print) < sizeof(mi->print) - 1) {
+	    strlen(mi->print) < MENU_MAXENTRY) {
 		const char	*marker = "";
 		char		 buf[MENU_MAXENTRY + 1];
 		int		 diff;
 
-		diff = sizeof(mi->print) - 1 - strlen(mi->print);
+		diff = MENU_MAXENTRY - strlen(mi->print);
 
 		/* One for the ':' */
 		diff -= 1;
@@ -175,29 +259,143 @@ search_print_client(struct menu *mi, int list)
 		}
 
 		(void)strlcpy(buf, mi->print, sizeof(buf));
-		(void)snprintf(mi->print, sizeof(mi->print),
+		(void)snprintf(mi->print, MENU_MAXENTRY + 1,
 		    "%s:%.*s%s", buf, diff, cc->name, marker);
 	}
 }
 
+/* Sort as the names will be shown, with a '/' after directories. */
+static int
+path_ent_cmp(const void *a, const void *b)
+{
+	const struct path_ent	*pa = a, *pb = b;
+	const unsigned char	*x = (const unsigned char *)pa->name;
+	const unsigned char	*y = (const unsigned char *)pb->name;
+	int			 cx, cy;
+
+	for (; *x != '\0' && *x == *y; x++, y++)
+		;
+	cx = (*x != '\0') ? *x : (pa->isdir ? '/' : '\0');
+	cy = (*y != '\0') ? *y : (pb->isdir ? '/' : '\0');
+
+	return(cx - cy);
+}
+
+/* Read dir, which is as typed and may be empty, unless it's unchanged. */
+static void
+path_cache_load(const char *dir)
+{
+	struct path_cache	*pc = &path_cache;
+	DIR			*dirp;
+	struct dirent		*dp;
+	struct stat		 sb;
+	const char		*open_dir = (*dir != '\0') ? dir : ".";
+	size_t			 i, nalloc = 0;
+
+	if (stat(open_dir, &sb) == -1)
+		sb.st_mtim.tv_sec = sb.st_mtim.tv_nsec = -1;
+	if (pc->dir != NULL && strcmp(pc->dir, dir) == 0 &&
+	    sb.st_mtim.tv_sec == pc->mtime.tv_sec &&
+	    sb.st_mtim.tv_nsec == pc->mtime.tv_nsec)
+		return;
+
+	for (i = 0; i < pc->nents; i++)
+		free(pc->ents[i].name);
+	free(pc->ents);
+	free(pc->dir);
+	if (pc->dfd != -1)
+		(void)close(pc->dfd);
+	pc->ents = NULL;
+	pc->nents = 0;
+	pc->dir = xstrdup(dir);
+	pc->mtime = sb.st_mtim;
+	pc->dfd = -1;
+
+	if ((dirp = opendir(open_dir)) == NULL)
+		return;
+	pc->dfd = fcntl(dirfd(dirp), F_DUPFD_CLOEXEC, 0);
+
+	while ((dp = readdir(dirp)) != NULL) {
+		if (pc->nents == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			pc->ents = xreallocarray(pc->ents, nalloc,
+			    sizeof(*pc->ents));
+		}
+		pc->ents[pc->nents].name = xstrdup(dp->d_name);
+		pc->ents[pc->nents].isexec = -1;
+		if (dp->d_type != DT_UNKNOWN && dp->d_type != DT_LNK)
+			pc->ents[pc->nents].isdir = (dp->d_type == DT_DIR);
+		else
+			/* Symlinks are marked after what they point to. */
+			pc->ents[pc->nents].isdir = fstatat(dirfd(dirp),
+			    dp->d_name, &sb, 0) == 0 && S_ISDIR(sb.st_mode);
+		pc->nents++;
+	}
+	(void)closedir(dirp);
+
+	if (pc->nents > 0)
+		qsort(pc->ents, pc->nents, sizeof(*pc->ents), path_ent_cmp);
+
+	log_debug("%s: %s: %zu entries", __func__, open_dir, pc->nents);
+}
+
+/*
+ * Complete search as a path, as glob(3) would with search followed by
+ * a '*' and GLOB_MARK.  Unless search has wildcards of its own, this
+ * filters a cached listing of its directory.
+ */
 static void
 search_match_path(struct menu_q *menuq, struct menu_q *resultq, char *search, int flag)
 {
-	char 	 pattern[PATH_MAX];
-	glob_t	 g;
-	int	 i;
+	struct path_ent	*pe;
+	char 		 pattern[PATH_MAX], *dir, *base, *p;
+	glob_t		 g;
+	size_t		 i, blen;
+	int		 j;
 
 	TAILQ_INIT(resultq);
 
+	if (strpbrk(search, "*?[\\") == NULL) {
+		dir = xstrdup(search);
+		if ((p = strrchr(dir, '/')) != NULL)
+			p++;
+		else
+			p = dir;
+		base = search + (p - dir);
+		blen = strlen(base);
+		*p = '\0';
+		path_cache_load(dir);
+
+		for (i = 0; i < path_cache.nents; i++) {
+			pe = &path_cache.ents[i];
+			if (strncmp(pe->name, base, blen) != 0)
+				continue;
+			/* Like glob, only show dotfiles if asked. */
+			if (pe->name[0] == '.' && base[0] != '.')
+				continue;
+			if (flag & PATH_EXEC) {
+				if (pe->isexec == -1)
+					pe->isexec = faccessat(path_cache.dfd,
+					    pe->name, X_OK, 0) == 0;
+				if (!pe->isexec)
+					continue;
+			}
+			menuq_add_result(menuq, resultq, NULL, "%s%s%s", dir,
+			    pe->name, pe->isdir ? "/" : "");
+		}
+		free(dir);
+		return;
+	}
+
 	(void)strlcpy(pattern, search, sizeof(pattern));
 	(void)strlcat(pattern, "*", sizeof(pattern));
 
 	if (glob(pattern, GLOB_MARK, NULL, &g) != 0)
 		return;
-	for (i = 0; i < g.gl_pathc; i++) {
-		if ((flag & PATH_EXEC) && access(g.gl_pathv[i], X_OK))
+	for (j = 0; j < g.gl_pathc; j++) {
+		if ((flag & PATH_EXEC) && access(g.gl_pathv[j], X_OK))
 			continue;
-		menuq_add(resultq, NULL, "%s", g.gl_pathv[i]);
+		menuq_add_result(menuq, resultq, NULL, "%s", g.gl_pathv[j]);
 	}
 	globfree(&g);
 }
@@ -217,37 +415,103 @@ search_match_path_any(struct menu_q *menuq, struct menu_q *resultq, char *search
 void
 search_match_text(struct menu_q *menuq, struct menu_q *resultq, char *search)
 {
-	struct menu	*mi;
+	struct search_sort	*v = NULL;
+	struct menu		*mi;
+	char			*fsearch;
+	size_t			 i, flen, n = 0, nalloc = 0;
 
 	TAILQ_INIT(resultq);
 
+	fsearch = u_fold(search);
+	flen = strlen(fsearch);
 	TAILQ_FOREACH(mi, menuq, entry)
-		if (strsubmatch(search, mi->text, 0))
-			TAILQ_INSERT_TAIL(resultq, mi, resultentry);
+		if (strsubmatch(fsearch, flen, mi->fold, 0))
+			search_sort_add(&v, &n, &nalloc, mi, 0,
+			    history_score(history_key(mi->text, NULL)));
+	free(fsearch);
+
+	qsort(v, n, sizeof(*v), search_rank_cmp);
+	for (i = 0; i < n; i++)
+		TAILQ_INSERT_TAIL(resultq, v[i].mi, resultentry);
+	free(v);
+}
+
+/* Most used first, then alphabetically. */
+static int
+search_sort_cmp(const void *a, const void *b)
+{
+	const struct search_sort	*sa = a, *sb = b;
+	int				 r;
+
+	if (sa->boost != sb->boost)
+		return(sa->boost > sb->boost ? -1 : 1);
+	if ((r = strcasecmp(sa->mi->text, sb->mi->text)) != 0)
+		return(r);
+	return(sa->idx < sb->idx ? -1 : sa->idx > sb->idx);
+}
+
+/* By tier, then most used first, otherwise keeping the menu's order. */
+static int
+search_rank_cmp(const void *a, const void *b)
+{
+	const struct search_sort	*sa = a, *sb = b;
+
+	if (sa->tier != sb->tier)
+		return(sa->tier < sb->tier ? -1 : 1);
+	if (sa->boost != sb->boost)
+		return(sa->boost > sb->boost ? -1 : 1);
+	return(sa->idx < sb->idx ? -1 : sa->idx > sb->idx);
+}
+
+static void
+search_sort_add(struct search_sort **v, size_t *n, size_t *nalloc,
+    struct menu *mi, int tier, float boost)
+{
+	if (*n == *nalloc) {
+		*nalloc = *nalloc ? *nalloc * 2 : 64;
+		*v = xreallocarray(*v, *nalloc, sizeof(**v));
+	}
+	(*v)[*n].mi = mi;
+	(*v)[*n].tier = tier;
+	(*v)[*n].boost = boost;
+	(*v)[*n].idx = *n;
+	(*n)++;
 }
 
+/*
+ * Matches sorted by use, then case-insensitively, keeping only the first of any
+ * entries which compare equal (the same command in two $PATH entries).
+ */
 void
 search_match_exec(struct menu_q *menuq, struct menu_q *resultq, char *search)
 {
-	struct menu	*mi, *mj;
-	int		 r;
+	struct search_sort	*v = NULL;
+	struct menu		*mi;
+	char			*fsearch;
+	size_t			 i, flen, n = 0, nalloc = 0;
 
 	TAILQ_INIT(resultq);
 
+	fsearch = u_fold(search);
+	flen = strlen(fsearch);
 	TAILQ_FOREACH(mi, menuq, entry) {
-		if (strsubmatch(search, mi->text, 1) == 0 &&
+		if (strsubmatch(fsearch, flen, mi->fold, 1) == 0 &&
 		    fnmatch(search, mi->text, 0) == FNM_NOMATCH)
 			continue;
-		TAILQ_FOREACH(mj, resultq, resultentry) {
-			r = strcasecmp(mi->text, mj->text);
-			if (r < 0)
-				TAILQ_INSERT_BEFORE(mj, mi, resultentry);
-			if (r <= 0)
-				break;
-		}
-		if (mj == NULL)
-			TAILQ_INSERT_TAIL(resultq, mi, resultentry);
+		search_sort_add(&v, &n, &nalloc, mi, 0,
+		    history_score(history_key(mi->text, NULL)));
+	}
+	free(fsearch);
+	if (n == 0)
+		return;
+
+	qsort(v, n, sizeof(*v), search_sort_cmp);
+	for (i = 0; i < n; i++) {
+		if (i > 0 && strcasecmp(v[i].mi->text, v[i - 1].mi->text) == 0)
+			continue;
+		TAILQ_INSERT_TAIL(resultq, v[i].mi, resultentry);
 	}
+	free(v);
 }
 
 void
@@ -258,29 +522,326 @@ search_match_exec_path(struct menu_q *menuq, struct menu_q *resultq, char *searc
 		search_match_path_exec(menuq, resultq, search);
 }
 
+/*
+ * Fuzzy matching: the search only has to appear as a subsequence.  Matches
+ * are scored on where the characters fall (word boundaries, runs, a match
+ * at the very start) and the best FUZZY_TOPK are sorted to the front; the
+ * rest follow in menu order, as they will never be on screen unsorted.
+ */
+void
+search_match_fuzzy(struct menu_q *menuq, struct menu_q *resultq, char *search)
+{
+	struct fuzzy_result	*v = NULL;
+	struct menu		*mi;
+	char			*pat;
+	uint64_t		 qmask;
+	size_t			 plen, n = 0, nalloc = 0;
+	int			 score;
+
+	TAILQ_INIT(resultq);
+
+	pat = u_fold(search);
+	plen = strlen(pat);
+	qmask = fuzzy_charmask(pat);
+
+	TAILQ_FOREACH(mi, menuq, entry) {
+		/* Anything lacking one of the characters can't match. */
+		if ((mi->charmask & FUZZY_MASKVALID) == 0)
+			mi->charmask = fuzzy_charmask(mi->fold);
+		if ((qmask & ~mi->charmask) != 0)
+			continue;
+		if (!fuzzy_score(pat, plen, mi->fold, mi->text, &score))
+			continue;
+		score += fuzzy_history(history_key(mi->text, NULL));
+
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			v = xreallocarray(v, nalloc, sizeof(*v));
+		}
+		v[n].mi = mi;
+		v[n].key = mi->text;
+		v[n].score = score;
+		v[n].top = 0;
+		v[n].len = strlen(mi->text);
+		v[n].idx = n;
+		n++;
+	}
+
+	fuzzy_rank(v, n, resultq, 1);
+	free(v);
+	free(pat);
+}
+
+void
+search_match_fuzzy_client(struct menu_q *menuq, struct menu_q *resultq,
+    char *search)
+{
+	struct fuzzy_result	*v = NULL;
+	struct winname		*wn;
+	struct menu		*mi;
+	struct client_ctx	*cc;
+	char			*pat;
+	const char		*key;
+	size_t			 plen, n = 0, nalloc = 0;
+	int			 score, best;
+
+	TAILQ_INIT(resultq);
+
+	pat = u_fold(search);
+	plen = strlen(pat);
+
+	TAILQ_FOREACH(mi, menuq, entry) {
+		cc = mi->ctx;
+		key = NULL;
+		best = 0;
+
+		/* Labels first, then titles newest first, then the class. */
+		if (cc->label != NULL && fuzzy_score(pat, plen, cc->label_fold,
+		    cc->label, &score)) {
+			key = cc->label;
+			best = score;
+		}
+		TAILQ_FOREACH_REVERSE(wn, &cc->nameq, winname_q, entry) {
+			if (fuzzy_score(pat, plen, wn->fold, wn->name,
+			    &score) &&
+			    (key == NULL || score > best)) {
+				key = wn->name;
+				best = score;
+			}
+		}
+		if (cc->ch.res_class != NULL &&
+		    fuzzy_score(pat, plen, cc->class_fold, cc->ch.res_class,
+		    &score) &&
+		    (key == NULL || score > best)) {
+			key = cc->ch.res_class;
+			best = score;
+		}
+		if (key == NULL)
+			continue;
+
+		cc->matchname = (char *)key;
+
+		/* As with search_match_client, the current window sinks. */
+		if (cc == client_current())
+			best -= FUZZY_MATCH;
+		best += fuzzy_history(history_key(cc->ch.res_class,
+		    cc->ch.res_name));
+
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			v = xreallocarray(v, nalloc, sizeof(*v));
+		}
+		v[n].mi = mi;
+		v[n].key = key;
+		v[n].score = best;
+		v[n].top = 0;
+		v[n].len = strlen(key);
+		v[n].idx = n;
+		n++;
+	}
+
+	fuzzy_rank(v, n, resultq, 0);
+	free(v);
+	free(pat);
+}
+
+void
+search_match_fuzzy_exec_path(struct menu_q *menuq, struct menu_q *resultq,
+    char *search)
+{
+	search_match_fuzzy(menuq, resultq, search);
+	if (TAILQ_EMPTY(resultq))
+		search_match_path_exec(menuq, resultq, search);
+}
+
+/* A bit per letter and digit, with everything else sharing the rest. */
+static uint64_t
+fuzzy_charmask(const char *s)
+{
+	uint64_t	 mask = FUZZY_MASKVALID;
+	int		 c;
+
+	for (; *s != '\0'; s++) {
+		c = tolower((unsigned char)*s);
+		if (c >= 'a' && c <= 'z')
+			mask |= 1ULL << (c - 'a');
+		else if (c >= '0' && c <= '9')
+			mask |= 1ULL << (c - '0' + 26);
+		else
+			mask |= 1ULL << (36 + c % 27);
+	}
+
+	return(mask);
+}
+
+/*
+ * Score pat against s, both folded.  The shortest window in which pat
+ * occurs is found by a forward then a backward scan, and only that window
+ * is scored.  orig, the unfolded string, is used for camelCase; it's only
+ * usable if folding didn't change the length.
+ */
 static int
-strsubmatch(char *sub, char *str, int zeroidx)
+fuzzy_score(const char *pat, size_t plen, const char *s, const char *orig,
+    int *score)
 {
-	size_t		 len, sublen;
-	unsigned int	 n, flen;
+	size_t	 i, pi, start, end, slen;
+	int	 bonus, consec = 0, gap = 0;
+	char	 c, prev;
 
-	if (sub == NULL || str == NULL)
+	if (s == NULL)
 		return(0);
+	slen = strlen(s);
+	if (strlen(orig) != slen)
+		orig = NULL;
 
-	len = strlen(str);
-	sublen = strlen(sub);
-
-	if (sublen > len)
+	for (i = 0, pi = 0; i < slen && pi < plen; i++) {
+		if (s[i] == pat[pi])
+			pi++;
+	}
+	if (pi < plen)
 		return(0);
+	end = i;
 
-	if (!zeroidx)
-		flen = len - sublen;
-	else
-		flen = 0;
+	for (i = end, pi = plen; i > 0 && pi > 0; i--) {
+		if (s[i - 1] == pat[pi - 1])
+			pi--;
+	}
+	start = i;
+
+	*score = (start == 0) ? FUZZY_PREFIX : 0;
+	for (i = start, pi = 0; i < end && pi < plen; i++) {
+		if (s[i] != pat[pi]) {
+			*score += gap ? FUZZY_GAP_EXT : FUZZY_GAP_START;
+			gap = 1;
+			consec = 0;
+			continue;
+		}
+
+		prev = (i > 0) ? s[i - 1] : '\0';
+		c = s[i];
+		if (i == 0 || strchr(" /-_.:,", prev) != NULL)
+			bonus = FUZZY_BOUNDARY;
+		else if (!isdigit((unsigned char)prev) &&
+		    isdigit((unsigned char)c))
+			bonus = FUZZY_CAMEL;
+		else if (orig != NULL && islower((unsigned char)orig[i - 1]) &&
+		    isupper((unsigned char)orig[i]))
+			bonus = FUZZY_CAMEL;
+		else
+			bonus = 0;
+		if (pi == 0)
+			bonus *= 2;
+		if (consec > 0)
+			bonus = MAX(bonus, FUZZY_CONSEC);
+
+		*score += FUZZY_MATCH + bonus;
+		consec++;
+		gap = 0;
+		pi++;
+	}
+
+	return(1);
+}
+
+/* A bounded bonus for what the history says is used often. */
+static int
+fuzzy_history(uint64_t key)
+{
+	float	 boost = history_score(key) * FUZZY_HISTORY;
+
+	return(boost > FUZZY_HISTORY_MAX ? FUZZY_HISTORY_MAX : (int)boost);
+}
+
+/* Does a rank before b?  Ties go to the shorter, then alphabetical. */
+static int
+fuzzy_better(const struct fuzzy_result *a, const struct fuzzy_result *b)
+{
+	int	 r;
+
+	if (a->score != b->score)
+		return(a->score > b->score);
+	if (a->len != b->len)
+		return(a->len < b->len);
+	if ((r = strcasecmp(a->key, b->key)) != 0)
+		return(r < 0);
+	return(a->idx < b->idx);
+}
+
+/* The heap keeps its worst entry at the root. */
+static void
+fuzzy_heap_down(struct fuzzy_result *h, size_t n, size_t i)
+{
+	struct fuzzy_result	 t;
+	size_t			 c;
+
+	while ((c = 2 * i + 1) < n) {
+		if (c + 1 < n && fuzzy_better(&h[c], &h[c + 1]))
+			c++;
+		if (!fuzzy_better(&h[i], &h[c]))
+			break;
+		t = h[i];
+		h[i] = h[c];
+		h[c] = t;
+		i = c;
+	}
+}
+
+static int
+fuzzy_rank_cmp(const void *a, const void *b)
+{
+	if (fuzzy_better(a, b))
+		return(-1);
+	return(fuzzy_better(b, a));
+}
+
+static void
+fuzzy_rank(struct fuzzy_result *v, size_t n, struct menu_q *resultq,
+    int dedup)
+{
+	struct fuzzy_result	*h;
+	struct menu		*last = NULL;
+	size_t			 i, k;
+
+	if (n == 0)
+		return;
+
+	k = MIN(n, FUZZY_TOPK);
+	h = xreallocarray(NULL, k, sizeof(*h));
+	memcpy(h, v, k * sizeof(*h));
+	for (i = k / 2; i > 0; i--)
+		fuzzy_heap_down(h, k, i - 1);
+	for (i = k; i < n; i++) {
+		if (fuzzy_better(&v[i], &h[0])) {
+			h[0] = v[i];
+			fuzzy_heap_down(h, k, 0);
+		}
+	}
+	qsort(h, k, sizeof(*h), fuzzy_rank_cmp);
+
+	for (i = 0; i < k; i++) {
+		v[h[i].idx].top = 1;
+		/* The same command from two $PATH entries, say. */
+		if (dedup && last != NULL &&
+		    strcasecmp(last->text, h[i].mi->text) == 0)
+			continue;
+		TAILQ_INSERT_TAIL(resultq, h[i].mi, resultentry);
+		last = h[i].mi;
+	}
+	for (i = 0; i < n; i++) {
+		if (!v[i].top)
+			TAILQ_INSERT_TAIL(resultq, v[i].mi, resultentry);
+	}
+	free(h);
+}
+
+static int
+strsubmatch(const char *sub, size_t sublen, const char *str, int zeroidx)
+{
+	if (sub == NULL || str == NULL)
+		return(0);
 
-	for (n = 0; n <= flen; n++)
-		if (strncasecmp(sub, str + n, sublen) == 0)
-			return(1);
+	if (zeroidx)
+		return(strncmp(str, sub, sublen) == 0);
 
-	return(0);
+	return(memmem(str, strlen(str), sub, sublen) != NULL);
 }
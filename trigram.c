@@ -0,0 +1,252 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Copyright (c) 2017 Thomas Adam <thomas@xteddy.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A trigram index over what window search looks at: each client's label,
+ * the titles in its name history and its class, all folded.
+ *
+ * A client can only match a search of three or more characters if it has
+ * every trigram of the search, so the clients listed under the search's
+ * rarest trigram are the only ones worth looking at.  Each client keeps the
+ * sorted set of its own trigrams, which is used both to check the others
+ * and to work out what changed when the client is indexed again.
+ */
+
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calmwm.h"
+
+#define TRIGRAM_NBUCKETS	4096
+
+struct trigram {
+	struct trigram		*next;
+	uint32_t		 key;
+	struct client_ctx	**list;
+	size_t			 n;
+	size_t			 nalloc;
+};
+
+static struct trigram	*trigram_buckets[TRIGRAM_NBUCKETS];
+
+static unsigned int	 trigram_hash(uint32_t);
+static struct trigram	*trigram_find(uint32_t, int);
+static void		 trigram_collect(const char *, uint32_t **, size_t *,
+			     size_t *);
+static int		 trigram_cmp(const void *, const void *);
+static int		 trigram_has(struct client_ctx *, uint32_t);
+static void		 trigram_link(struct client_ctx *, uint32_t);
+static void		 trigram_unlink(struct client_ctx *, uint32_t);
+
+static unsigned int
+trigram_hash(uint32_t key)
+{
+	return(((key * 2654435761U) >> 20) % TRIGRAM_NBUCKETS);
+}
+
+static struct trigram *
+trigram_find(uint32_t key, int create)
+{
+	struct trigram	*t;
+	unsigned int	 h = trigram_hash(key);
+
+	for (t = trigram_buckets[h]; t != NULL; t = t->next) {
+		if (t->key == key)
+			return(t);
+	}
+	if (!create)
+		return(NULL);
+
+	t = xcalloc(1, sizeof(*t));
+	t->key = key;
+	t->next = trigram_buckets[h];
+	trigram_buckets[h] = t;
+
+	return(t);
+}
+
+static void
+trigram_collect(const char *s, uint32_t **v, size_t *n, size_t *nalloc)
+{
+	const unsigned char	*p = (const unsigned char *)s;
+	size_t			 len;
+
+	if (s == NULL || (len = strlen(s)) < 3)
+		return;
+
+	for (; len >= 3; p++, len--) {
+		if (*n == *nalloc) {
+			*nalloc = *nalloc ? *nalloc * 2 : 64;
+			*v = xreallocarray(*v, *nalloc, sizeof(**v));
+		}
+		(*v)[(*n)++] = (p[0] << 16) | (p[1] << 8) | p[2];
+	}
+}
+
+static int
+trigram_cmp(const void *a, const void *b)
+{
+	uint32_t	 x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return(x < y ? -1 : x > y);
+}
+
+static int
+trigram_has(struct client_ctx *cc, uint32_t key)
+{
+	return(bsearch(&key, cc->trigrams, cc->ntrigrams,
+	    sizeof(*cc->trigrams), trigram_cmp) != NULL);
+}
+
+static void
+trigram_link(struct client_ctx *cc, uint32_t key)
+{
+	struct trigram	*t = trigram_find(key, 1);
+
+	if (t->n == t->nalloc) {
+		t->nalloc = t->nalloc ? t->nalloc * 2 : 4;
+		t->list = xreallocarray(t->list, t->nalloc, sizeof(*t->list));
+	}
+	t->list[t->n++] = cc;
+}
+
+static void
+trigram_unlink(struct client_ctx *cc, uint32_t key)
+{
+	struct trigram	*t, **tp;
+	size_t		 i;
+
+	if ((t = trigram_find(key, 0)) == NULL)
+		return;
+
+	for (i = 0; i < t->n; i++) {
+		if (t->list[i] == cc) {
+			t->list[i] = t->list[--t->n];
+			break;
+		}
+	}
+	if (t->n > 0)
+		return;
+
+	for (tp = &trigram_buckets[trigram_hash(key)]; *tp != t;
+	    tp = &(*tp)->next)
+		;
+	*tp = t->next;
+	free(t->list);
+	free(t);
+}
+
+/* (Re)index a client after its label, titles or class have changed. */
+void
+trigram_update(struct client_ctx *cc)
+{
+	struct winname	*wn;
+	uint32_t	*v = NULL;
+	size_t		 i, j, n = 0, nalloc = 0, m;
+
+	trigram_collect(cc->label_fold, &v, &n, &nalloc);
+	TAILQ_FOREACH(wn, &cc->nameq, entry)
+		trigram_collect(wn->fold, &v, &n, &nalloc);
+	trigram_collect(cc->class_fold, &v, &n, &nalloc);
+
+	if (n > 0) {
+		qsort(v, n, sizeof(*v), trigram_cmp);
+		for (i = 1, m = 1; i < n; i++) {
+			if (v[i] != v[m - 1])
+				v[m++] = v[i];
+		}
+		n = m;
+	}
+
+	/* Both sets are sorted; merge them to find what came and went. */
+	i = j = 0;
+	while (i < cc->ntrigrams || j < n) {
+		if (j == n || (i < cc->ntrigrams && cc->trigrams[i] < v[j]))
+			trigram_unlink(cc, cc->trigrams[i++]);
+		else if (i == cc->ntrigrams || v[j] < cc->trigrams[i])
+			trigram_link(cc, v[j++]);
+		else {
+			i++;
+			j++;
+		}
+	}
+
+	free(cc->trigrams);
+	cc->trigrams = v;
+	cc->ntrigrams = n;
+}
+
+void
+trigram_remove(struct client_ctx *cc)
+{
+	size_t	 i;
+
+	for (i = 0; i < cc->ntrigrams; i++)
+		trigram_unlink(cc, cc->trigrams[i]);
+	free(cc->trigrams);
+	cc->trigrams = NULL;
+	cc->ntrigrams = 0;
+}
+
+/*
+ * List the clients which might match the folded search s in *list, which
+ * the caller frees.  Returns -1 if s is too short for the index to say
+ * anything, in which case every client might match.
+ */
+int
+trigram_candidates(const char *s, size_t len, struct client_ctx ***list,
+    size_t *nlist)
+{
+	struct trigram		*t, *best = NULL;
+	struct client_ctx	*cc;
+	uint32_t		*v = NULL;
+	size_t			 i, j, n = 0, nalloc = 0;
+
+	*list = NULL;
+	*nlist = 0;
+	if (len < 3)
+		return(-1);
+
+	trigram_collect(s, &v, &n, &nalloc);
+	for (i = 0; i < n; i++) {
+		if ((t = trigram_find(v[i], 0)) == NULL) {
+			/* Nothing has this trigram, so nothing matches. */
+			free(v);
+			return(0);
+		}
+		if (best == NULL || t->n < best->n)
+			best = t;
+	}
+
+	*list = xreallocarray(NULL, best->n, sizeof(**list));
+	for (i = 0; i < best->n; i++) {
+		cc = best->list[i];
+		for (j = 0; j < n; j++) {
+			if (v[j] != best->key && !trigram_has(cc, v[j]))
+				break;
+		}
+		if (j == n)
+			(*list)[(*nlist)++] = cc;
+	}
+	free(v);
+
+	return(0);
+}
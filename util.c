@@ -19,7 +19,9 @@
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
+#include <ctype.h>
 #include <fcntl.h>
 #include <err.h>
 #include <errno.h>
@@ -28,6 +30,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <wchar.h>
+#include <wctype.h>
 
 #include "calmwm.h"
 #include "parson.h"
@@ -85,6 +89,92 @@ u_exec(char *argstr)
 	(void)execvp(args[0], args);
 }
 
+/*
+ * 64-bit FNV-1a.  Pass 0 as the seed to start a new hash, or a previous
+ * result to continue one.
+ */
+uint64_t
+u_hash(const void *p, size_t len, uint64_t h)
+{
+	const unsigned char	*s = p;
+
+	if (h == 0)
+		h = 0xcbf29ce484222325ULL;
+	while (len-- > 0) {
+		h ^= *s++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return(h);
+}
+
+/* The path of a file called name under $XDG_CACHE_HOME, or ~/.cache. */
+char *
+u_cache_path(const char *name)
+{
+	const char	*dir;
+	char		*path, *file;
+
+	if ((dir = getenv("XDG_CACHE_HOME")) != NULL && *dir != '\0')
+		path = xstrdup(dir);
+	else
+		xasprintf(&path, "%s/.cache", homedir);
+
+	if (mkdir(path, 0700) == -1 && errno != EEXIST) {
+		log_debug("%s: mkdir %s: %s", __func__, path, strerror(errno));
+		free(path);
+		return(NULL);
+	}
+
+	xasprintf(&file, "%s/%s", path, name);
+	free(path);
+
+	return(file);
+}
+
+/*
+ * A lowercased copy of s, for searching.  Multibyte characters are folded
+ * according to the locale; bytes which don't decode are copied as they
+ * are.
+ */
+char *
+u_fold(const char *s)
+{
+	mbstate_t	 in, out;
+	wchar_t		 wc;
+	size_t		 len, n, m;
+	char		*fold, *d;
+
+	len = strlen(s);
+	fold = d = xreallocarray(NULL, len + 1, MB_CUR_MAX);
+
+	memset(&in, 0, sizeof(in));
+	memset(&out, 0, sizeof(out));
+	while (len > 0) {
+		n = mbrtowc(&wc, s, len, &in);
+		if (n == (size_t)-1 || n == (size_t)-2) {
+			memset(&in, 0, sizeof(in));
+			*d++ = tolower((unsigned char)*s);
+			s++;
+			len--;
+			continue;
+		}
+		if (n == 0)
+			break;
+		if ((m = wcrtomb(d, towlower(wc), &out)) == (size_t)-1) {
+			memset(&out, 0, sizeof(out));
+			memcpy(d, s, n);
+			m = n;
+		}
+		d += m;
+		s += n;
+		len -= n;
+	}
+	*d = '\0';
+
+	return(fold);
+}
+
 void
 u_init_pipe(void)
 {
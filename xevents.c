@@ -48,8 +48,13 @@ static void	 xev_handle_keypress(XEvent *);
 static void	 xev_handle_keyrelease(XEvent *);
 static void	 xev_handle_clientmessage(XEvent *);
 static void	 xev_handle_randr(XEvent *);
+static void	 xev_handle_syncalarm(XEvent *);
 static void	 xev_handle_mappingnotify(XEvent *);
 static void	 xev_handle_expose(XEvent *);
+static Bool	 xev_key_pred(Display *, XEvent *, XPointer);
+
+static XKeyEvent	*xev_key;	/* the key press being handled */
+static XButtonEvent	*xev_btn;	/* the button press being handled */
 
 void		(*xev_handlers[LASTEvent])(XEvent *) = {
 			[MapRequest] = xev_handle_maprequest,
@@ -85,7 +90,7 @@ xev_handle_maprequest(XEvent *ee)
 	if ((cc != NULL) && (!(cc->flags & CLIENT_IGNORE)))
 		client_ptrwarp(cc);
 
-	rule_apply(cc, "on-map");
+	rule_apply(cc, RULE_ON_MAP);
 	client_log_debug(__func__, cc);
 
 }
@@ -101,8 +106,8 @@ xev_handle_unmapnotify(XEvent *ee)
 			client_set_wm_state(cc, WithdrawnState);
 		} else {
 			if (!(cc->flags & CLIENT_HIDDEN)) {
+				rule_apply(cc, RULE_ON_CLOSE);
 				client_delete(cc);
-				rule_apply(cc, "on-close");
 			}
 		}
 	}
@@ -115,8 +120,8 @@ xev_handle_destroynotify(XEvent *ee)
 	struct client_ctx	*cc;
 
 	if ((cc = client_find(e->window)) != NULL) {
+		rule_apply(cc, RULE_ON_CLOSE);
 		client_delete(cc);
-		rule_apply(cc, "on-close");
 	}
 }
 
@@ -196,8 +201,12 @@ xev_handle_propertynotify(XEvent *ee)
 		case XA_WM_TRANSIENT_FOR:
 			client_transient(cc);
 			break;
+		case XA_WM_CLASS:
+			client_setclass(cc);
+			break;
 		default:
-			/* do nothing */
+			if (e->atom == ewmh[_NET_WM_WINDOW_TYPE])
+				match_client_invalidate(cc, MATCH_TYPE);
 			break;
 		}
 	} else {
@@ -239,7 +248,7 @@ xev_handle_enternotify(XEvent *ee)
 
 	if ((cc = client_find(e->window)) != NULL) {
 		client_setactive(cc);
-		rule_apply(cc, "on-focus");
+		rule_apply(cc, RULE_ON_FOCUS);
 	}
 }
 
@@ -272,7 +281,19 @@ xev_handle_buttonpress(XEvent *ee)
 		cc->sc = screen_find(e->window);
 	}
 
+	xev_btn = e;
 	(*mb->callback)(cc, &mb->argument);
+	xev_btn = NULL;
+}
+
+/*
+ * The button press whose binding is running, if any; its pointer grab is
+ * active and its position current, which saves asking the server.
+ */
+const XButtonEvent *
+xev_button(void)
+{
+	return(xev_btn);
 }
 
 static void
@@ -338,7 +359,46 @@ xev_handle_keypress(XEvent *ee)
 		    __func__, cc->sc->name);
 	}
 
+	xev_key = e;
 	(*kb->callback)(cc, &kb->argument);
+	xev_key = NULL;
+}
+
+static Bool
+xev_key_pred(Display *dpy, XEvent *e, XPointer arg)
+{
+	int	*stop = (int *)arg;
+
+	if (*stop || (e->type != KeyPress && e->type != KeyRelease))
+		return(False);
+	if (e->type == KeyPress && e->xkey.keycode == xev_key->keycode &&
+	    (e->xkey.state & ~IGNOREMODMASK) == xev_key->state)
+		return(True);
+	*stop = 1;
+	return(False);
+}
+
+/*
+ * Take the auto-repeats of the key being handled off the queue, as far as
+ * the first other key event, and return how many there were; a binding
+ * can then do the work of all of them at once rather than falling behind
+ * the key.  Repeats only come as lone presses with detectable auto-repeat,
+ * which x_init() asks for; without it the release in between stops this.
+ */
+int
+xev_key_repeats(void)
+{
+	XEvent	 e;
+	int	 stop = 0, n = 0;
+
+	if (xev_key == NULL)
+		return(0);
+	while (XCheckIfEvent(X_Dpy, &e, xev_key_pred, (XPointer)&stop))
+		n++;
+	if (n > 0)
+		log_debug("%s: %d repeats of key %u", __func__, n,
+		    xev_key->keycode);
+	return(n);
 }
 
 /*
@@ -386,7 +446,7 @@ xev_handle_clientmessage(XEvent *ee)
 		if ((old_cc = client_current()))
 			client_ptrsave(old_cc);
 
-		rule_apply(cc, "on-net-active");
+		rule_apply(cc, RULE_ON_NET_ACTIVE);
 	}
 
 	if (e->message_type == ewmh[_NET_WM_DESKTOP] && e->format == 32) {
@@ -427,9 +487,17 @@ xev_handle_randr(XEvent *ee)
 	}
 }
 
+static void
+xev_handle_syncalarm(XEvent *ee)
+{
+	XSyncAlarmNotifyEvent	*e = (XSyncAlarmNotifyEvent *)ee;
+
+	client_sync_alarm(e->alarm);
+}
+
 /*
  * Called when the keymap has changed.
- * Ungrab all keys, reload keymap and then regrab
+ * Reload the keymap and then regrab whichever keycodes have moved.
  */
 static void
 xev_handle_mappingnotify(XEvent *ee)
@@ -461,8 +529,17 @@ xev_process(void)
 	XEvent		 e;
 
 	XNextEvent(X_Dpy, &e);
-	if ((e.type - Randr_ev) == RRScreenChangeNotify) {
-		xev_handle_randr(&e);
-	} else if (e.type < LASTEvent && xev_handlers[e.type] != NULL)
-		(*xev_handlers[e.type])(&e);
+	xev_dispatch(&e);
+}
+
+/* Also used by menus, to pass on what they don't handle themselves. */
+void
+xev_dispatch(XEvent *e)
+{
+	if ((e->type - Randr_ev) == RRScreenChangeNotify) {
+		xev_handle_randr(e);
+	} else if (HasSync && (e->type - Sync_ev) == XSyncAlarmNotify) {
+		xev_handle_syncalarm(e);
+	} else if (e->type < LASTEvent && xev_handlers[e->type] != NULL)
+		(*xev_handlers[e->type])(e);
 }
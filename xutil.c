@@ -32,8 +32,14 @@
 
 static unsigned int ign_mods[] = { 0, LockMask, Mod2Mask, Mod2Mask | LockMask };
 
-void
-xu_btn_grab(Window win, int mask, unsigned int btn)
+static void	 xu_btn_grab(Window, unsigned int, unsigned int);
+static void	 xu_btn_ungrab(Window, unsigned int, unsigned int);
+static void	 xu_key_grab(Window, unsigned int, unsigned int);
+static void	 xu_key_ungrab(Window, unsigned int, unsigned int);
+static int	 xu_grab_cmp(const void *, const void *);
+
+static void
+xu_btn_grab(Window win, unsigned int mask, unsigned int btn)
 {
 	unsigned int	i;
 
@@ -43,32 +49,158 @@ xu_btn_grab(Window win, int mask, unsigned int btn)
 		    GrabModeSync, None, None);
 }
 
-void
-xu_btn_ungrab(Window win)
+static void
+xu_btn_ungrab(Window win, unsigned int mask, unsigned int btn)
 {
-	XUngrabButton(X_Dpy, AnyButton, AnyModifier, win);
+	unsigned int	i;
+
+	for (i = 0; i < nitems(ign_mods); i++)
+		XUngrabButton(X_Dpy, btn, (mask | ign_mods[i]), win);
 }
 
-void
-xu_key_grab(Window win, unsigned int mask, KeySym keysym)
+static void
+xu_key_grab(Window win, unsigned int mask, unsigned int code)
 {
-	KeyCode		 code = 0;
 	unsigned int	 i;
 
-	code = XKeysymToKeycode(X_Dpy, keysym);
-	if ((XkbKeycodeToKeysym(X_Dpy, code, 0, 0) != keysym) &&
-	    (XkbKeycodeToKeysym(X_Dpy, code, 0, 1) == keysym))
-		mask |= ShiftMask;
-
 	for (i = 0; i < nitems(ign_mods); i++)
 		XGrabKey(X_Dpy, code, (mask | ign_mods[i]), win,
 		    True, GrabModeAsync, GrabModeAsync);
 }
 
+static void
+xu_key_ungrab(Window win, unsigned int mask, unsigned int code)
+{
+	unsigned int	 i;
+
+	for (i = 0; i < nitems(ign_mods); i++)
+		XUngrabKey(X_Dpy, code, (mask | ign_mods[i]), win);
+}
+
+/*
+ * Map a keysym to the keycode to grab.  If the keysym is only reachable
+ * with Shift, ShiftMask is added to *mask.  Returns 0 if the keysym isn't
+ * on the keyboard at all.
+ */
+KeyCode
+xu_key_resolve(KeySym keysym, unsigned int *mask)
+{
+	KeyCode		 code;
+
+	if ((code = XKeysymToKeycode(X_Dpy, keysym)) == 0)
+		return(0);
+	if ((XkbKeycodeToKeysym(X_Dpy, code, 0, 0) != keysym) &&
+	    (XkbKeycodeToKeysym(X_Dpy, code, 0, 1) == keysym))
+		*mask |= ShiftMask;
+
+	return(code);
+}
+
 void
-xu_key_ungrab(Window win)
+xu_grab_add(struct grab_set *gs, unsigned int code, unsigned int mask)
+{
+	gs->list = xreallocarray(gs->list, gs->num + 1, sizeof(*gs->list));
+	gs->list[gs->num].code = code;
+	gs->list[gs->num].mask = mask;
+	gs->num++;
+}
+
+void
+xu_grab_clear(struct grab_set *gs)
+{
+	free(gs->list);
+	gs->list = NULL;
+	gs->num = 0;
+}
+
+static int
+xu_grab_cmp(const void *a, const void *b)
+{
+	const struct grab	*ga = a, *gb = b;
+
+	if (ga->code != gb->code)
+		return(ga->code < gb->code ? -1 : 1);
+	if (ga->mask != gb->mask)
+		return(ga->mask < gb->mask ? -1 : 1);
+	return(0);
+}
+
+/*
+ * Bring the grabs on win from *cur to *want, touching only the (code,
+ * mask) pairs which differ.  *want is consumed and becomes the new *cur.
+ */
+void
+xu_grab_update(Window win, struct grab_set *cur, struct grab_set *want,
+    int type)
+{
+	size_t		 i = 0, j = 0, n = 0;
+	int		 r, changed = 0;
+
+	/* Sort and drop duplicates so the two sets can be merged. */
+	if (want->num > 0) {
+		qsort(want->list, want->num, sizeof(*want->list), xu_grab_cmp);
+		for (i = 1; i < want->num; i++) {
+			if (xu_grab_cmp(&want->list[i], &want->list[n]) != 0)
+				want->list[++n] = want->list[i];
+		}
+		want->num = n + 1;
+	}
+
+	i = 0;
+	while (i < cur->num || j < want->num) {
+		if (i == cur->num)
+			r = 1;
+		else if (j == want->num)
+			r = -1;
+		else
+			r = xu_grab_cmp(&cur->list[i], &want->list[j]);
+
+		if (r == 0) {
+			i++;
+			j++;
+			continue;
+		}
+
+		/* Don't let a key fall through to a client mid-update. */
+		if (!changed++ && type == GRAB_KEY)
+			XGrabServer(X_Dpy);
+
+		if (r < 0) {
+			if (type == GRAB_KEY)
+				xu_key_ungrab(win, cur->list[i].mask,
+				    cur->list[i].code);
+			else
+				xu_btn_ungrab(win, cur->list[i].mask,
+				    cur->list[i].code);
+			i++;
+		} else {
+			if (type == GRAB_KEY)
+				xu_key_grab(win, want->list[j].mask,
+				    want->list[j].code);
+			else
+				xu_btn_grab(win, want->list[j].mask,
+				    want->list[j].code);
+			j++;
+		}
+	}
+
+	if (changed && type == GRAB_KEY)
+		XUngrabServer(X_Dpy);
+	if (changed)
+		log_debug("%s: window 0x%lx: %d grab(s) changed", __func__,
+		    win, changed);
+
+	free(cur->list);
+	*cur = *want;
+	want->list = NULL;
+	want->num = 0;
+}
+
+void
+xu_key_ungrab_all(Window win, struct grab_set *cur)
 {
 	XUngrabKey(X_Dpy, AnyKey, AnyModifier, win);
+	xu_grab_clear(cur);
 }
 
 int
@@ -82,8 +214,12 @@ xu_ptr_grab(Window win, unsigned int mask, Cursor curs)
 int
 xu_ptr_regrab(unsigned int mask, Cursor curs)
 {
-	return(XChangeActivePointerGrab(X_Dpy, mask,
-	    curs, CurrentTime) == GrabSuccess ? 0 : -1);
+	/*
+	 * There's no reply, so it returns 1 (not GrabSuccess) whatever
+	 * happens; the server ignores it unless we hold the pointer.
+	 */
+	XChangeActivePointerGrab(X_Dpy, mask, curs, CurrentTime);
+	return(0);
 }
 
 void